@@ -0,0 +1,38 @@
+-- Secondary indexes for the queries of db.ort, which ort-sql(1) can't
+-- declare.  These are applied when the database is created and on each
+-- `make updatedb`, so they must be idempotent.
+-- Run `make queryplan` to check that every query uses an index.
+
+-- Date listings (report.lastdate).
+
+CREATE INDEX IF NOT EXISTS report_ctime
+	ON report (ctime);
+
+-- Project listings (report.dashname) and the newest report of a
+-- machine for a project (report.latest).
+
+CREATE INDEX IF NOT EXISTS report_projectid
+	ON report (projectid, machineid, ctime);
+
+-- Machine listings (report.dashuname).
+
+CREATE INDEX IF NOT EXISTS report_machineid
+	ON report (machineid, projectid, ctime);
+
+-- The newest report of each project and machine in listings
+-- (report.dashname and report.dashuname), grouped by this.
+
+CREATE INDEX IF NOT EXISTS report_projmachine
+	ON report (projmachine);
+
+-- Project trends (rollup.byproject).  Machine trends use the unique
+-- index of rollup.
+
+CREATE INDEX IF NOT EXISTS rollup_projectid
+	ON rollup (projectid, day);
+
+-- Scopes changed since a report (scope.changed), as read by
+-- minci-render.
+
+CREATE INDEX IF NOT EXISTS scope_lastid
+	ON scope (lastid);
@@ -0,0 +1,9 @@
+-- Settings kept in the database file itself, as the generated database
+-- layer can't issue pragmas.  These are applied when the database is
+-- created and on each `make updatedb`, so they must be idempotent.
+
+-- Write-ahead logging, so readers aren't blocked by a report being
+-- inserted (nor it by them).  SQLite needs to create the -wal and -shm
+-- files alongside the database, so its directory must be writable.
+
+PRAGMA journal_mode = WAL;
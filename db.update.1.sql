@@ -0,0 +1,16 @@
+-- Data migration 1 of `make updatedb`, run once after ort-sqldiff(1)
+-- has created the tables and columns of db.ort.  Columns since dropped
+-- from db.ort are added here for the migrations that need them.
+
+BEGIN;
+
+-- Move the log and uname -v out of report and into reportdetail.
+
+ALTER TABLE reportdetail ADD COLUMN log TEXT NOT NULL DEFAULT '';
+INSERT INTO reportdetail (reportid, log, unamev)
+	SELECT id, log, unamev FROM report;
+ALTER TABLE report DROP COLUMN log;
+ALTER TABLE report DROP COLUMN unamev;
+
+PRAGMA user_version = 1;
+COMMIT;
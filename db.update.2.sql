@@ -0,0 +1,29 @@
+-- Data migration 2 of `make updatedb`, run once after ort-sqldiff(1)
+-- has created the tables and columns of db.ort.  Columns since dropped
+-- from db.ort are added here for the migrations that need them.
+
+BEGIN;
+
+-- Seed projsummary from the newest report of each project's machines.
+
+ALTER TABLE projsummary ADD COLUMN nhash TEXT NOT NULL DEFAULT '';
+WITH latest AS (
+	SELECT r.projectid, r.fetchhead, r.ctime, r.distcheck
+	FROM report AS r
+	WHERE r.ctime = (SELECT MAX(ctime) FROM report
+		WHERE projunamehash = r.projunamehash)
+), newest AS (
+	SELECT projectid, fetchhead AS nhash, MAX(ctime) AS nctime
+	FROM latest GROUP BY projectid
+)
+INSERT INTO projsummary
+	(projectid, nhash, nctime, finished, success, pending)
+	SELECT n.projectid, n.nhash, n.nctime,
+	 SUM(n.nhash <> '' AND l.fetchhead = n.nhash),
+	 SUM(n.nhash <> '' AND l.fetchhead = n.nhash AND l.distcheck <> 0),
+	 SUM(n.nhash = '' OR l.fetchhead <> n.nhash)
+	FROM newest AS n JOIN latest AS l ON l.projectid = n.projectid
+	GROUP BY n.projectid;
+
+PRAGMA user_version = 2;
+COMMIT;
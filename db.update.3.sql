@@ -0,0 +1,25 @@
+-- Data migration 3 of `make updatedb`, run once after ort-sqldiff(1)
+-- has created the tables and columns of db.ort.  Columns since dropped
+-- from db.ort are added here for the migrations that need them.
+
+BEGIN;
+
+-- Seed the listing validators from existing reports.
+
+INSERT INTO scope (name, lastid, mtime)
+	SELECT 'index', id, ctime FROM report
+	ORDER BY id DESC LIMIT 1;
+INSERT INTO scope (name, lastid, mtime)
+	SELECT 'project/' || project.name, MAX(report.id),
+	 MAX(report.ctime)
+	FROM report INNER JOIN project ON project.id = report.projectid
+	GROUP BY report.projectid;
+INSERT INTO scope (name, lastid, mtime)
+	SELECT 'uname/' || unamehash, MAX(id), MAX(ctime) FROM report
+	GROUP BY unamehash;
+INSERT INTO scope (name, lastid, mtime)
+	SELECT 'date/' || (ctime - ctime % 86400), MAX(id), MAX(ctime)
+	FROM report GROUP BY ctime - ctime % 86400;
+
+PRAGMA user_version = 3;
+COMMIT;
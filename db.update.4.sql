@@ -0,0 +1,29 @@
+-- Data migration 4 of `make updatedb`, run once after ort-sqldiff(1)
+-- has created the tables and columns of db.ort.  Columns since dropped
+-- from db.ort are added here for the migrations that need them.
+
+BEGIN;
+
+-- Move each distinct log out of reportdetail into logblob.  SQLite
+-- can't compute MD5, so existing non-empty logs get random digests:
+-- these won't be shared with new reports having the same log, but are
+-- otherwise just as good.  The empty log of passing reports gets its
+-- real digest.
+
+ALTER TABLE logblob ADD COLUMN log TEXT NOT NULL DEFAULT '';
+INSERT INTO logblob (digest, log, refs)
+	SELECT CASE log WHEN '' THEN 'd41d8cd98f00b204e9800998ecf8427e'
+	 ELSE lower(hex(randomblob(16))) END, log, COUNT(*)
+	FROM reportdetail GROUP BY log;
+CREATE TEMPORARY TABLE logmap AS
+	SELECT reportdetail.reportid AS reportid, logblob.digest AS digest
+	FROM reportdetail INNER JOIN logblob
+	ON logblob.log = reportdetail.log;
+CREATE INDEX temp.logmap_reportid ON logmap (reportid);
+UPDATE report SET logdigest =
+	(SELECT digest FROM logmap WHERE logmap.reportid = report.id);
+DROP TABLE logmap;
+ALTER TABLE reportdetail DROP COLUMN log;
+
+PRAGMA user_version = 4;
+COMMIT;
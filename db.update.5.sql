@@ -0,0 +1,17 @@
+-- Data migration 5 of `make updatedb`, run once after ort-sqldiff(1)
+-- has created the tables and columns of db.ort.  Columns since dropped
+-- from db.ort are added here for the migrations that need them.
+
+BEGIN;
+
+-- Move each log out of logblob into logchunk.  SQLite can't compress,
+-- so existing logs are kept as they are, each in a single raw chunk.
+-- Only new logs are compressed.
+
+UPDATE logblob SET size = length(CAST(log AS BLOB)), enc = 0;
+INSERT INTO logchunk (logblobid, seq, data)
+	SELECT id, 0, CAST(log AS BLOB) FROM logblob WHERE log <> '';
+ALTER TABLE logblob DROP COLUMN log;
+
+PRAGMA user_version = 5;
+COMMIT;
@@ -0,0 +1,38 @@
+-- Data migration 6 of `make updatedb`, run once after ort-sqldiff(1)
+-- has created the tables and columns of db.ort.  Columns since dropped
+-- from db.ort are added here for the migrations that need them.
+
+BEGIN;
+
+-- Fill in the line count and tail of existing logs.  These are all
+-- raw, in a single chunk (whose offs and line default to zero), as
+-- only new logs are compressed.  The tail is taken from the last 8 KiB
+-- of the log, so it may be shorter than that of new logs.
+
+CREATE TEMPORARY TABLE logend AS
+	SELECT logblobid AS id, CAST(data AS TEXT) AS log,
+	 substr(CAST(data AS TEXT), -8192) AS s
+	FROM logchunk INNER JOIN logblob ON logblob.id = logblobid
+	WHERE logblob.enc = 0;
+CREATE TEMPORARY TABLE logend_nl AS
+	WITH RECURSIVE nl(id, s, pos) AS (
+		SELECT id, s, instr(s, char(10)) FROM logend
+		WHERE instr(s, char(10)) > 0
+		UNION ALL
+		SELECT id, s, pos + instr(substr(s, pos + 1), char(10))
+		FROM nl WHERE instr(substr(s, pos + 1), char(10)) > 0
+	) SELECT id, pos FROM nl;
+UPDATE logblob SET
+	lines = (SELECT length(log) - length(replace(log, char(10), '')) +
+	 (substr(log, -1) <> char(10)) FROM logend
+	 WHERE logend.id = logblob.id),
+	tail = (SELECT COALESCE(substr(s, (SELECT pos FROM logend_nl
+	 WHERE logend_nl.id = logend.id ORDER BY pos DESC
+	 LIMIT 1 OFFSET 16) + 1), s) FROM logend
+	 WHERE logend.id = logblob.id)
+	WHERE id IN (SELECT id FROM logend);
+DROP TABLE logend_nl;
+DROP TABLE logend;
+
+PRAGMA user_version = 6;
+COMMIT;
@@ -0,0 +1,85 @@
+-- Data migration 7 of `make updatedb`, run once after ort-sqldiff(1)
+-- has created the tables and columns of db.ort.  Columns since dropped
+-- from db.ort are added here for the migrations that need them.
+
+BEGIN;
+
+-- Move each machine's uname out of its reports into machine, keyed by
+-- the old report.unamehash, which is computed just as machine.hash.
+
+INSERT INTO machine (unamem, unamen, unamer, unames, hash)
+	SELECT unamem, unamen, unamer, unames, unamehash
+	FROM report GROUP BY unamehash;
+UPDATE report SET machineid =
+	(SELECT id FROM machine WHERE machine.hash = report.unamehash);
+UPDATE report SET projmachine = projectid << 32 | machineid;
+
+-- Machine listings are now scoped by machine identifier.
+
+UPDATE scope SET name = 'machine/' ||
+	(SELECT id FROM machine WHERE hash = substr(scope.name, 7))
+	WHERE name LIKE 'uname/%' AND substr(name, 7) IN
+	(SELECT hash FROM machine);
+
+-- Drop the old columns, first dropping the indexes using them (these
+-- are re-created by db.index.sql).
+
+DROP INDEX IF EXISTS report_projectid;
+DROP INDEX IF EXISTS report_unamehash;
+DROP INDEX IF EXISTS report_projunamehash;
+ALTER TABLE report DROP COLUMN unamem;
+ALTER TABLE report DROP COLUMN unamen;
+ALTER TABLE report DROP COLUMN unamer;
+ALTER TABLE report DROP COLUMN unames;
+ALTER TABLE report DROP COLUMN unamehash;
+ALTER TABLE report DROP COLUMN projunamehash;
+
+-- The unique constraint of rollup has changed, so it's re-created
+-- (as by ort-sql(1)) and filled from the durations of all reports, as
+-- submit_durations() computes them.
+
+DROP TABLE rollup;
+CREATE TABLE rollup (
+	projectid INTEGER NOT NULL REFERENCES project(id),
+	machineid INTEGER NOT NULL DEFAULT 0 REFERENCES machine(id),
+	day INTEGER NOT NULL,
+	stage INTEGER NOT NULL,
+	count INTEGER NOT NULL,
+	total INTEGER NOT NULL,
+	regressed INTEGER NOT NULL,
+	id INTEGER PRIMARY KEY,
+	UNIQUE (projectid, machineid, day, stage)
+);
+CREATE TEMPORARY TABLE stagedur AS
+	SELECT projectid, machineid, ctime - ctime % 86400 AS day,
+	 0 AS stage, env - start AS dur, regress & 1 AS flag
+	 FROM report WHERE env != 0
+	UNION ALL
+	SELECT projectid, machineid, ctime - ctime % 86400,
+	 1, depend - env, (regress >> 1) & 1
+	 FROM report WHERE depend != 0
+	UNION ALL
+	SELECT projectid, machineid, ctime - ctime % 86400,
+	 2, build - depend, (regress >> 2) & 1
+	 FROM report WHERE build != 0
+	UNION ALL
+	SELECT projectid, machineid, ctime - ctime % 86400,
+	 3, test - build, (regress >> 3) & 1
+	 FROM report WHERE test != 0
+	UNION ALL
+	SELECT projectid, machineid, ctime - ctime % 86400,
+	 4, install - test, (regress >> 4) & 1
+	 FROM report WHERE install != 0
+	UNION ALL
+	SELECT projectid, machineid, ctime - ctime % 86400,
+	 5, distcheck - install, (regress >> 5) & 1
+	 FROM report WHERE distcheck != 0;
+INSERT INTO rollup 
+	(projectid, machineid, day, stage, count, total, regressed)
+	SELECT projectid, machineid, day, stage, 
+	 COUNT(*), SUM(dur), SUM(flag)
+	FROM stagedur GROUP BY projectid, machineid, day, stage;
+DROP TABLE stagedur;
+
+PRAGMA user_version = 7;
+COMMIT;
@@ -0,0 +1,25 @@
+-- Data migration 8 of `make updatedb`, run once after ort-sqldiff(1)
+-- has created the tables and columns of db.ort.  Columns since dropped
+-- from db.ort are added here for the migrations that need them.
+
+BEGIN;
+
+-- Move each project's commit hashes out of its reports and summary
+-- into revision, first seen when first reported.
+
+INSERT INTO revision (projectid, hash, ctime)
+	SELECT projectid, fetchhead, MIN(ctime)
+	FROM report GROUP BY projectid, fetchhead;
+UPDATE report SET revisionid =
+	(SELECT id FROM revision 
+	 WHERE revision.projectid = report.projectid
+	 AND revision.hash = report.fetchhead);
+UPDATE projsummary SET nrevisionid =
+	(SELECT id FROM revision 
+	 WHERE revision.projectid = projsummary.projectid
+	 AND revision.hash = projsummary.nhash);
+ALTER TABLE report DROP COLUMN fetchhead;
+ALTER TABLE projsummary DROP COLUMN nhash;
+
+PRAGMA user_version = 8;
+COMMIT;
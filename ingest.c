@@ -0,0 +1,249 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2020 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <sys/types.h>
+#include <sys/file.h> /* flock */
+
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <md5.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <kcgi.h>
+#include <kcgijson.h> /* extern.h */
+
+#include "extern.h"
+#include "minci.h"
+
+/*
+ * Default greatest number of submissions per transaction.
+ */
+#define	INGESTMAX 256
+
+/*
+ * Select committed spool files for scandir(3): not hidden, not being
+ * written, not set aside, and not the lock.
+ */
+static int
+ingest_select(const struct dirent *dp)
+{
+
+	return dp->d_name[0] != '.' &&
+		strncmp(dp->d_name, "tmp.", 4) &&
+		strncmp(dp->d_name, "bad.", 4) &&
+		strcmp(dp->d_name, "lock");
+}
+
+/*
+ * Set aside a spool file that can't be read or inserted by prefixing
+ * its name with "bad.", so it's kept for the administrator but not
+ * tried again.
+ */
+static void
+ingest_bad(const char *name)
+{
+	char	 from[PATH_MAX], to[PATH_MAX];
+
+	snprintf(from, sizeof(from), SPOOLDIR "/%s", name);
+	snprintf(to, sizeof(to), SPOOLDIR "/bad.%s", name);
+	warnx("%s: set aside", from);
+	if (rename(from, to) == -1)
+		warn("%s", to);
+}
+
+/*
+ * Remove the spool files of inserted submissions.
+ */
+static void
+ingest_done(struct dirent **names, size_t sz)
+{
+	char	 path[PATH_MAX];
+	size_t	 i;
+
+	for (i = 0; i < sz; i++) {
+		snprintf(path, sizeof(path), 
+			SPOOLDIR "/%s", names[i]->d_name);
+		if (unlink(path) == -1)
+			warn("%s", path);
+	}
+}
+
+/*
+ * Insert up to "max" spooled submissions, oldest first, in a single
+ * transaction.
+ * If the transaction fails, each is tried in its own, setting aside
+ * those that still fail.
+ * Spool files are removed once committed: if we're killed in between,
+ * they're inserted again.
+ * Returns the number of spool files handled or -1 on failure.
+ */
+static ssize_t
+ingest(struct ort *db, size_t max)
+{
+	struct dirent	**names;
+	struct spooled	 *sp;
+	char		  path[PATH_MAX];
+	size_t		  i, j, sz;
+	int		  n;
+
+	if ((n = scandir(SPOOLDIR, &names, ingest_select, alphasort)) == -1) {
+		warn(SPOOLDIR);
+		return -1;
+	}
+
+	sz = (size_t)n > max ? max : (size_t)n;
+	sp = kcalloc(sz, sizeof(struct spooled));
+
+	/* Set aside unreadable files, keeping the rest in order. */
+
+	for (i = j = 0; i < sz; i++) {
+		snprintf(path, sizeof(path), 
+			SPOOLDIR "/%s", names[i]->d_name);
+		if (spool_read(db, path, &sp[j])) {
+			names[j++] = names[i];
+			continue;
+		}
+		spool_free(&sp[j]);
+		ingest_bad(names[i]->d_name);
+		free(names[i]);
+	}
+
+	db_trans_open(db, 1, 1);
+	for (i = 0; i < j; i++)
+		if (submit_insert(db, &sp[i].s, 
+		    sp[i].userid, sp[i].ctime) == -1)
+			break;
+
+	if (i == j) {
+		db_trans_commit(db, 1);
+		ingest_done(names, j);
+	} else {
+		db_trans_rollback(db, 1);
+		warnx("batch failed: trying one at a time");
+		for (i = 0; i < j; i++) {
+			db_trans_open(db, 1, 1);
+			if (submit_insert(db, &sp[i].s, 
+			    sp[i].userid, sp[i].ctime) == -1) {
+				db_trans_rollback(db, 1);
+				ingest_bad(names[i]->d_name);
+				continue;
+			}
+			db_trans_commit(db, 1);
+			ingest_done(&names[i], 1);
+		}
+	}
+
+	if (j > 0)
+		cache_bump();
+
+	for (i = 0; i < j; i++) {
+		spool_free(&sp[i]);
+		free(names[i]);
+	}
+	for (i = sz; i < (size_t)n; i++)
+		free(names[i]);
+	free(names);
+	free(sp);
+	return sz;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct ort	*db;
+	const char	*er;
+	size_t		 max = INGESTMAX;
+	unsigned int	 wait = 0;
+	ssize_t		 n;
+	int		 c, fd, rc = EXIT_FAILURE;
+
+	while ((c = getopt(argc, argv, "n:w:")) != -1)
+		switch (c) {
+		case 'n':
+			max = strtonum(optarg, 1, INT_MAX, &er);
+			if (er != NULL)
+				errx(EXIT_FAILURE, "-n: %s", er);
+			break;
+		case 'w':
+			wait = strtonum(optarg, 0, 86400, &er);
+			if (er != NULL)
+				errx(EXIT_FAILURE, "-w: %s", er);
+			break;
+		default:
+			goto usage;
+		}
+
+	argc -= optind;
+	if (argc != 0)
+		goto usage;
+
+	/* Only one committer at a time: the others just exit. */
+
+	if ((fd = open(SPOOLDIR "/lock", O_RDWR | O_CREAT, 0600)) == -1)
+		err(EXIT_FAILURE, SPOOLDIR "/lock");
+	if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+		if (errno == EWOULDBLOCK)
+			return EXIT_SUCCESS;
+		err(EXIT_FAILURE, SPOOLDIR "/lock");
+	}
+
+	if ((db = db_open_logging
+	    (DATADIR "/minci.db", NULL, warnx, NULL)) == NULL)
+		errx(EXIT_FAILURE, "db_open: %s", DATADIR "/minci.db");
+
+	/* Reading and removing the spool, evicting the cache. */
+
+	if (pledge("stdio rpath wpath cpath", NULL) == -1) {
+		warn("pledge");
+		goto out;
+	}
+
+	db_role(db, ROLE_producer);
+
+	/* 
+	 * Drain the spool, then (if waiting) check it again every
+	 * "wait" seconds.
+	 */
+
+	for (;;) {
+		if ((n = ingest(db, max)) == -1)
+			goto out;
+		if ((size_t)n == max)
+			continue;
+		if (wait == 0)
+			break;
+		sleep(wait);
+	}
+
+	rc = EXIT_SUCCESS;
+out:
+	db_close(db);
+	close(fd);
+	return rc;
+usage:
+	fprintf(stderr, "usage: %s [-n batch] [-w seconds]\n", 
+		getprogname());
+	return EXIT_FAILURE;
+}
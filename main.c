@@ -15,25 +15,34 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 #include <sys/queue.h>
-#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/file.h> /* flock */
+#include <sys/stat.h>
 
 #include <assert.h>
+#include <ctype.h>
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <math.h> /* floor */
 #include <md5.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <zlib.h>
 
 #include <kcgi.h>
 #include <kcgihtml.h>
+#include <kcgijson.h>
 
 #include "extern.h"
+#include "minci.h"
 
 #ifndef REPO_BASE
 #define REPO_BASE "https://github.com/kristapsdz"
@@ -41,1191 +50,4028 @@
 #ifndef COMMIT_BASE
 #define COMMIT_BASE REPO_BASE
 #endif
+#ifndef PAGESZ
+#define PAGESZ 50
+#endif
+#ifndef STATICDIR
+#define STATICDIR DATADIR "/../htdocs/minci"
+#endif
+#ifndef STATICURL
+#define STATICURL "/minci"
+#endif
+#ifndef CGIURL
+#define CGIURL "/cgi-bin/minci.cgi"
+#endif
+#ifndef TIMINGDIR
+#define TIMINGDIR DATADIR "/timing"
+#endif
+
+/*
+ * Greatest page size of a listing, which must be one less than the
+ * limit of the paged report queries in db.ort.
+ */
+#define	PAGEMAX 100
+
+/*
+ * Greatest number of reports in a batch submission.
+ */
+#define	BATCHMAX 64
+
+/*
+ * Days shown by trend pages.
+ */
+#define	TRENDDAYS 90
+
+/*
+ * Default and greatest lines per page of the log viewer.
+ */
+#define	LOGPAGE 500
+#define	LOGPAGEMAX 5000
+
+/*
+ * Bytes of each block of the request's arena (see arena_alloc()).
+ */
+#define	ARENASZ 65536
+
+/*
+ * Seconds of each window of latency histograms, and the number of
+ * their buckets (see hist_le).
+ */
+#define	HISTWIN 300
+#define	HISTBKT 13
+
+/*
+ * Bytes of markup assembled in memory before being written (see struct
+ * hbuf).
+ */
+#define	HBUFSZ 65536
+
+/*
+ * Append the string literal "s" to the markup of "h".
+ */
+#define	HBUF_BLOB(h, s) \
+	kcgi_buf_write((s), sizeof(s) - 1, &(h)->b)
+
+/*
+ * Phases of handling a request, timed by timing_phase().
+ */
+enum	phase {
+	PHASE_PARSE, /* khttp_parse() */
+	PHASE_OPEN, /* db_open_logging() */
+	PHASE_SQL, /* queries and inserts */
+	PHASE_RENDER, /* headers and body */
+	PHASE_CACHE, /* cache_send() */
+	PHASE__MAX
+};
 
 enum	page {
+	PAGE_BATCH,
 	PAGE_INDEX,
+	PAGE_LOG,
+	PAGE_TREND,
 	PAGE__MAX
 };
 
+/*
+ * A response being rendered into the cache (see cache_fill_open()).
+ */
+struct	cache {
+	int	 fd; /* temporary file of response */
+	int	 stdfd; /* saved standard output */
+	char	 tmp[PATH_MAX]; /* temporary file name */
+	char	 path[PATH_MAX]; /* cached file name */
+};
+
+/*
+ * Cache validators of a resource: a single report or a scope of them
+ * (see the scope structure).
+ */
+struct	tag {
+	int64_t	 id; /* report or newest report in scope (or zero) */
+	time_t	 mtime; /* when that report was created */
+	time_t	 day; /* if not zero, day ending a window of days */
+};
+
+/*
+ * A log being read chunk by chunk (see log_read()).
+ */
+struct	logread {
+	z_stream	 z;
+	int		 inflate; /* inflate chunks before passing on */
+	int		 end; /* inflated to the end of the stream */
+	int		 ok; /* no errors so far */
+	int		 (*cb)(const char *, size_t, void *);
+	void		*arg; /* passed to cb */
+};
+
+/*
+ * A window of bytes or lines of a log being written as it's read (see
+ * log_read_window()).
+ */
+struct	logwin {
+	struct kreq	*r;
+	struct khtmlreq	 html; /* if lines */
+	int64_t		 first; /* first byte or line */
+	int64_t		 last; /* last byte or line (inclusive) */
+	int64_t		 pos; /* byte or line of the next read */
+	int		 open; /* line element is open */
+};
+
+/*
+ * Time spent by the current request in each phase, with the rows and
+ * body bytes it has written (see timing_begin()).
+ * Bytes are those written by our own writers (markup assembled by struct
+ * hbuf, logs, and cached responses) before any compression.
+ */
+struct	timing {
+	struct timespec	 start; /* of request */
+	struct timespec	 last; /* of current phase */
+	enum phase	 phase; /* current phase or PHASE__MAX */
+	double		 ms[PHASE__MAX]; /* milliseconds per phase */
+	size_t		 rows; /* reports or projects written */
+	size_t		 bytes; /* body bytes written */
+	enum khttp	 code; /* response status or KHTTP__MAX */
+	int		 nohead; /* no Server-Timing (see timing_head()) */
+	int		 fd; /* histogram (see timing_open()) or -1 */
+	char		 endpoint[32]; /* (see timing_open()) */
+};
+
+/*
+ * A window of a latency histogram (see timing_hist()).
+ */
+struct	hist {
+	int64_t		 start; /* epoch of window */
+	int64_t		 count; /* requests */
+	int64_t		 sum; /* microseconds of all requests */
+	int64_t		 bkt[HISTBKT]; /* requests per hist_le */
+};
+
+/*
+ * A block of memory of the request's arena (see arena_alloc()).
+ */
+struct	arenablk {
+	struct arenablk	*next; /* older block */
+	size_t		 sz; /* bytes of buf */
+	size_t		 used; /* bytes of buf given out */
+	char		 buf[];
+};
+
+/*
+ * Markup written around and between that of khtml(3): the constant
+ * fragments of pages and the rows of listings, which are assembled in
+ * memory and written in large pieces by hbuf_flush().
+ * Markup of khtml(3) may only follow once this has been flushed.
+ */
+struct	hbuf {
+	struct kcgi_writer	*w;
+	struct kcgi_buf		 b;
+};
+
 /*
  * Passed to each iterated row of listing.
  */
 struct	req {
 	struct kreq	*r;
 	struct khtmlreq	 html;
-	char		*nhash; /* newest hash of the set */
-	int		 checkhash; /* mark newest hash */
+	struct hbuf	 hb; /* rows of HTML listing */
+	struct kjsonreq	 json;
+	void		(*cb)(const struct report *, void *); /* row */
+	int64_t		 nrevision; /* if not zero, mark others */
+	size_t		 key; /* ORT field scoping listing */
+	size_t		 max; /* page size */
+	int		 hasbefore; /* page starts at "before" */
+	int		 hasafter; /* page ends at "after" */
+	int64_t		 before; /* or newest if not hasbefore */
+	int64_t		 after;
+	size_t		 count; /* rows on page */
+	int		 more; /* rows past page */
+	int64_t		 first; /* first row on page */
+	int64_t		 last; /* last row on page */
+};
+
+/*
+ * Timing of the current request.
+ */
+static struct timing timing = { .fd = -1 };
+
+static const char *const phases[PHASE__MAX] = {
+	"parse", /* PHASE_PARSE */
+	"open", /* PHASE_OPEN */
+	"sql", /* PHASE_SQL */
+	"render", /* PHASE_RENDER */
+	"cache", /* PHASE_CACHE */
 };
 
+/*
+ * Upper bounds in milliseconds of the buckets of latency histograms
+ * but for the last, which has the rest.
+ */
+static const double hist_le[HISTBKT - 1] = {
+	1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000
+};
+
+/*
+ * Strings built while handling the current request, newest block first
+ * (see arena_alloc()).
+ */
+static struct arenablk *arena;
+
+/*
+ * Where URLs are assembled before being copied into the arena (see
+ * url_partx()).
+ */
+static struct kcgi_buf urlbuf;
+
+/*
+ * Set while rendering pages into STATICDIR (see main_render()), when
+ * links to reports and listings are to their rendered pages.
+ */
+static int rendering;
+
+/*
+ * URL of the dashboard from a report or listing.
+ */
+#define	URL_DASH (rendering ? STATICURL "/index.html" : "index.html")
+
 static const char *const pages[PAGE__MAX] = {
+	"batch", /* PAGE_BATCH */
 	"index", /* PAGE_INDEX */
+	"log", /* PAGE_LOG */
+	"trend", /* PAGE_TREND */
 };
 
 /*
- * When computing the main dashboard, use this structure to winnow out
- * statistics for each project.
+ * Milliseconds from "from" to "to".
  */
-struct	dash {
-	const struct project	*proj; /* project in question */
-	const char		*nhash; /* newest commit hash */
-	time_t			 nctime; /* newest ctime of nhash */
-	size_t			 finished; /* members of nhash */
-	size_t			 success; /* ...and success members */
-	size_t			 pending; /* non-members */
-};
+static double
+timing_ms(const struct timespec *from, const struct timespec *to)
+{
+
+	return (to->tv_sec - from->tv_sec) * 1000.0 +
+		(to->tv_nsec - from->tv_nsec) / 1000000.0;
+}
 
 /*
- * Open our HTTP document by emitting all headers.
- * If mime isn't KMIME__MAX, use its content type.
- * If last is non-zero, use it as the last-modified time.
+ * Start timing a new request.
  */
 static void
-http_open(struct kreq *r,
-	enum khttp code, enum kmime mime, time_t last)
+timing_begin(void)
 {
-	char	datebuf[32];
 
-	if (last)
-		kutil_epoch2str(last, datebuf, sizeof(datebuf));
-
-	khttp_head(r, kresps[KRESP_STATUS], "%s", khttps[code]);
-	if (mime != KMIME__MAX)
-		khttp_head(r, kresps[KRESP_CONTENT_TYPE], 
-			"%s", kmimetypes[mime]);
-	if (last)
-		khttp_head(r, kresps[KRESP_LAST_MODIFIED], 
-			"%s", datebuf);
-	khttp_body(r);
+	memset(&timing, 0, sizeof(struct timing));
+	clock_gettime(CLOCK_MONOTONIC, &timing.start);
+	timing.last = timing.start;
+	timing.phase = PHASE__MAX;
+	timing.code = KHTTP__MAX;
+	timing.fd = -1;
 }
 
 /*
- * Open our HTML document with the correct document type, HTML envelope,
- * and header element.
- * This concludes with an open body envelope.
+ * Account for the time spent in the current phase, if any, and start
+ * timing "phase" (PHASE__MAX for none) from now.
+ * Returns the phase being left.
  */
-static void
-html_open(struct khtmlreq *req, const char *title)
-{
-
-	khtml_elem(req, KELEM_DOCTYPE);
-	khtml_elem(req, KELEM_HTML);
-	khtml_elem(req, KELEM_HEAD);
-	khtml_elem(req, KELEM_TITLE);
-	khtml_puts(req, "Minimal CI: ");
-	khtml_puts(req, title);
-	khtml_closeelem(req, 1); /* title */
-	khtml_attr(req, KELEM_META, 
-		KATTR_NAME, "viewport",
-		KATTR_CONTENT, "width=device-width, initial-scale=1",
-		KATTR__MAX);
-	khtml_attr(req, KELEM_META, 
-		KATTR_CHARSET, "utf-8",
-		KATTR__MAX);
-	khtml_attrx(req, KELEM_LINK, 
-		KATTR_REL, KATTRX_STRING, "stylesheet",
-		KATTR_HREF, KATTRX_STRING, "/minci.css",
-		KATTR__MAX);
-	khtml_closeelem(req, 1); /* head */
-	khtml_elem(req, KELEM_BODY);
+static enum phase
+timing_phase(enum phase phase)
+{
+	struct timespec	 now;
+	enum phase	 prev = timing.phase;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (prev != PHASE__MAX)
+		timing.ms[prev] += timing_ms(&timing.last, &now);
+	timing.last = now;
+	timing.phase = phase;
+	return prev;
 }
 
 /*
- * Format the uname fields to have useful (and short) output.
+ * Name the endpoint of "r" for the timing log and, if the TIMINGDIR
+ * directory exists, open the file of its latency histogram.
+ * This must be done before pledge(2) and the histogram closed with
+ * timing_end().
  */
 static void
-get_html_uname(struct khtmlreq *req, const struct report *p)
+timing_open(const struct kreq *r)
 {
+	const char	*kind;
+	char		 path[PATH_MAX];
+
+	if (r->method == KMETHOD_POST)
+		kind = r->page == PAGE_BATCH ? "batch" : "post";
+	else if (r->page == PAGE__MAX)
+		kind = "unknown";
+	else if (r->page != PAGE_INDEX)
+		kind = pages[r->page];
+	else if (r->fieldmap[VALID_REPORT_ID] != NULL)
+		kind = "report";
+	else if (r->fieldmap[VALID_PROJECT_NAME] != NULL)
+		kind = "project";
+	else if (r->fieldmap[VALID_REPORT_MACHINEID] != NULL)
+		kind = "machine";
+	else if (r->fieldmap[VALID_REPORT_CTIME] != NULL)
+		kind = "date";
+	else
+		kind = "dash";
 
-	khtml_puts(req, p->unames);
-	khtml_puts(req, " ");
-	khtml_puts(req, p->unamer);
-	khtml_puts(req, " ");
-	khtml_puts(req, p->unamem);
+	if (r->method == KMETHOD_POST || r->mime == KMIME__MAX)
+		strlcpy(timing.endpoint, kind, sizeof(timing.endpoint));
+	else
+		snprintf(timing.endpoint, sizeof(timing.endpoint),
+			"%s.%s", kind, ksuffixes[r->mime]);
 
-	/* This isn't particularly useful information. */
-#if 0
-	khtml_puts(req, "|");
-	khtml_puts(req, p->unamev);
-#endif
+	if (access(TIMINGDIR, F_OK) == -1)
+		return;
+
+	snprintf(path, sizeof(path), 
+		TIMINGDIR "/%s", timing.endpoint);
+	if ((timing.fd = open(path, O_RDWR | O_CREAT, 0600)) == -1)
+		warn("%s", path);
 }
 
 /*
- * Print a block with a time offset of "start" to "given".
- * If "given" is zero, suppress any content printing.
+ * Read a window of a histogram from its line at "cp", which is moved
+ * past it.
+ * Missing or malformed fields are zero.
  */
 static void
-get_html_offs(struct khtmlreq *req,
-	const char *classes, int64_t start, int64_t given)
+hist_read(char **cp, struct hist *h)
 {
+	size_t	 i;
 
-	khtml_attr(req, KELEM_DIV,
-		KATTR_CLASS, classes, KATTR__MAX);
-	if (given != 0) {
-		khtml_attrx(req, KELEM_TIME, 
-			KATTR_CLASS, KATTRX_STRING, "success",
-			KATTR_DATETIME, KATTRX_INT, given, 
-			KATTR__MAX);
-		khtml_int(req, given - start);
-		khtml_closeelem(req, 1); /* time */
-	} else {
-		khtml_attr(req, KELEM_SPAN, 
-			KATTR_CLASS, "fail", KATTR__MAX);
-		khtml_closeelem(req, 1); /* span */
-	}
-	khtml_closeelem(req, 1); /* div */
+	h->start = strtoll(*cp, cp, 10);
+	h->count = strtoll(*cp, cp, 10);
+	h->sum = strtoll(*cp, cp, 10);
+	for (i = 0; i < HISTBKT; i++)
+		h->bkt[i] = strtoll(*cp, cp, 10);
 }
 
 /*
- * Print the first row of a report table.
+ * Write a window of a histogram as a line into "buf".
+ * Returns the length written.
+ */
+static size_t
+hist_write(char *buf, size_t sz, const struct hist *h)
+{
+	size_t	 i, len;
+
+	len = snprintf(buf, sz, "%" PRId64 " %" PRId64 " %" PRId64,
+		h->start, h->count, h->sum);
+	for (i = 0; i < HISTBKT && len < sz; i++)
+		len += snprintf(buf + len, sz - len, 
+			" %" PRId64, h->bkt[i]);
+	if (len < sz)
+		len += snprintf(buf + len, sz - len, "\n");
+	return len < sz ? len : sz - 1;
+}
+
+/*
+ * Add a request of "ms" to the endpoint's latency histogram.
+ * The file has two lines, the current window of HISTWIN seconds and
+ * the one before, each of which is the start of the window, the number
+ * of requests, their sum in microseconds, then the number of requests
+ * per bucket (see hist_le).
+ * Windows roll over as requests come in.
  */
 static void
-get_html_last_header(struct khtmlreq *req)
+timing_hist(double ms)
 {
+	struct hist	 h[2];
+	char		 buf[1024], *cp = buf;
+	ssize_t		 ssz;
+	size_t		 i, len;
+	time_t		 now = time(NULL);
+
+	if (flock(timing.fd, LOCK_EX) == -1 ||
+	    (ssz = pread(timing.fd, buf, sizeof(buf) - 1, 0)) == -1) {
+		warn("%s", timing.endpoint);
+		return;
+	}
+	buf[ssz] = '\0';
+	hist_read(&cp, &h[0]);
+	hist_read(&cp, &h[1]);
+
+	if (now - h[0].start >= HISTWIN) {
+		if (now - h[0].start < 2 * HISTWIN)
+			h[1] = h[0];
+		else
+			memset(&h[1], 0, sizeof(struct hist));
+		memset(&h[0], 0, sizeof(struct hist));
+		h[0].start = now - now % HISTWIN;
+	}
 
-	khtml_attr(req, KELEM_DIV, 
-		KATTR_CLASS, "row", KATTR__MAX);
-	khtml_attr(req, KELEM_DIV, KATTR_CLASS, 
-		"head report-passfail", KATTR__MAX);
-	khtml_closeelem(req, 1); /* cell */
-	khtml_attr(req, KELEM_DIV, KATTR_CLASS, 
-		"head report-id", KATTR__MAX);
-	khtml_closeelem(req, 1); /* cell */
-	khtml_attr(req, KELEM_DIV, KATTR_CLASS, 
-		"head report-commit", KATTR__MAX);
-	khtml_closeelem(req, 1); /* cell */
-	khtml_attr(req, KELEM_DIV, KATTR_CLASS, 
-		"head report-start", KATTR__MAX);
-	khtml_closeelem(req, 1); /* cell */
-	khtml_attr(req, KELEM_DIV, KATTR_CLASS, 
-		"head project-name", KATTR__MAX);
-	khtml_closeelem(req, 1); /* cell */
-	khtml_attr(req, KELEM_DIV, KATTR_CLASS, 
-		"head report-system", KATTR__MAX);
-	khtml_closeelem(req, 1); /* cell */
-	khtml_attr(req, KELEM_DIV, 
-		KATTR_CLASS, "cellgroup", KATTR__MAX);
-	khtml_attr(req, KELEM_DIV, KATTR_CLASS, 
-		"head report-env", KATTR__MAX);
-	khtml_closeelem(req, 1); /* cell */
-	khtml_attr(req, KELEM_DIV, KATTR_CLASS, 
-		"head report-deps", KATTR__MAX);
-	khtml_closeelem(req, 1); /* cell */
-	khtml_attr(req, KELEM_DIV, KATTR_CLASS, 
-		"head report-build", KATTR__MAX);
-	khtml_closeelem(req, 1); /* cell */
-	khtml_attr(req, KELEM_DIV, KATTR_CLASS, 
-		"head report-regress", KATTR__MAX);
-	khtml_closeelem(req, 1); /* cell */
-	khtml_attr(req, KELEM_DIV, KATTR_CLASS, 
-		"head report-install", KATTR__MAX);
-	khtml_closeelem(req, 1); /* cell */
-	khtml_attr(req, KELEM_DIV, KATTR_CLASS, 
-		"head report-dist", KATTR__MAX);
-	khtml_closeelem(req, 1); /* cell */
-	khtml_closeelem(req, 1); /* cellgroup */
-	khtml_closeelem(req, 1); /* row */
+	for (i = 0; i < HISTBKT - 1; i++)
+		if (ms <= hist_le[i])
+			break;
+	h[0].bkt[i]++;
+	h[0].count++;
+	h[0].sum += ms * 1000.0;
+
+	len = hist_write(buf, sizeof(buf), &h[0]);
+	len += hist_write(buf + len, sizeof(buf) - len, &h[1]);
+	if (pwrite(timing.fd, buf, len, 0) != (ssize_t)len ||
+	    ftruncate(timing.fd, len) == -1)
+		warn("%s", timing.endpoint);
 }
 
 /*
- * Print a record as it would appear in an HTML table.
+ * Finish timing the request by logging its phases, rows, and bytes as
+ * a single line of "key=value" pairs, then adding it to its endpoint's
+ * histogram, if open.
  */
 static void
-get_html_last_report(const struct report *p, void *arg)
+timing_end(struct kreq *r)
 {
-	struct req	*r = arg;
-	struct tm	 tm;
-	int64_t		 date;
-	char		*urlid, *urlproj, *urldate, *urlcommit, 
-			*urluname;
-	char		 commitshort[8];
+	struct timespec	 now;
+	double		 total;
+
+	timing_phase(PHASE__MAX);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	total = timing_ms(&timing.start, &now);
+
+	kutil_info(r, NULL, "timing endpoint=%s status=%.3s "
+		"total=%.3f parse=%.3f open=%.3f sql=%.3f render=%.3f "
+		"cache=%.3f rows=%zu bytes=%zu", timing.endpoint, 
+		timing.code == KHTTP__MAX ? "-" : khttps[timing.code],
+		total, timing.ms[PHASE_PARSE], timing.ms[PHASE_OPEN],
+		timing.ms[PHASE_SQL], timing.ms[PHASE_RENDER],
+		timing.ms[PHASE_CACHE], timing.rows, timing.bytes);
+
+	if (timing.fd != -1) {
+		timing_hist(total);
+		close(timing.fd);
+		timing.fd = -1;
+	}
+}
 
-	if (r->nhash == NULL &&
-	    r->checkhash && p->fetchhead[0] != '\0')
-		r->nhash = kstrdup(p->fetchhead);
+/*
+ * Emit the phases timed so far as the Server-Timing header, then time
+ * what follows as rendering.
+ * The header is left out of responses rendered into the cache, which
+ * would otherwise be sent with each cache hit.
+ */
+static void
+timing_head(struct kreq *r, enum khttp code)
+{
+	struct timespec	 now;
+	char		 buf[256];
+	size_t		 i, len = 0;
+
+	timing.code = code;
+	timing_phase(timing.phase);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	for (i = 0; i < PHASE__MAX && len < sizeof(buf); i++)
+		len += snprintf(buf + len, sizeof(buf) - len,
+			"%s;dur=%.3f, ", phases[i], timing.ms[i]);
+	if (len < sizeof(buf))
+		snprintf(buf + len, sizeof(buf) - len, "total;dur=%.3f",
+			timing_ms(&timing.start, &now));
+
+	if (!timing.nohead)
+		khttp_head(r, "Server-Timing", "%s", buf);
+	timing_phase(PHASE_RENDER);
+}
 
-	memset(&tm, 0, sizeof(struct tm));
-	KUTIL_EPOCH2TM(p->ctime, &tm);
-	date = kutil_date2epoch
-		(tm.tm_mday, tm.tm_mon + 1, tm.tm_year + 1900);
+/*
+ * Whether the client accepts gzip, in which case kcgi will compress
+ * the response.
+ */
+static int
+http_gzip(const struct kreq *r)
+{
 
-	urlid = khttp_urlpartx(r->r->pname, 
-		ksuffixes[KMIME_TEXT_HTML],
-		pages[PAGE_INDEX],
-		valid_keys[VALID_REPORT_ID].name,
-		KATTRX_INT, p->id, NULL);
-	urlproj = khttp_urlpartx(r->r->pname, 
-		ksuffixes[KMIME_TEXT_HTML],
-		pages[PAGE_INDEX],
-		valid_keys[VALID_PROJECT_NAME].name,
-		KATTRX_STRING, p->project.name, NULL);
-	urldate = khttp_urlpartx(r->r->pname, 
-		ksuffixes[KMIME_TEXT_HTML],
-		pages[PAGE_INDEX],
-		valid_keys[VALID_REPORT_CTIME].name,
-		KATTRX_INT, date, NULL);
-	kasprintf(&urlcommit, "%s/%s/tree/%s",
-		COMMIT_BASE, p->project.name,
-		p->fetchhead);
-	urluname = khttp_urlpart(r->r->pname,
-		ksuffixes[KMIME_TEXT_HTML],
-		pages[PAGE_INDEX],
-		valid_keys[VALID_REPORT_UNAMEHASH].name,
-		p->unamehash, NULL);
+	return r->reqmap[KREQU_ACCEPT_ENCODING] != NULL &&
+		strstr(r->reqmap[KREQU_ACCEPT_ENCODING]->val,
+		"gzip") != NULL;
+}
 
-	memset(&tm, 0, sizeof(struct tm));
-	KUTIL_EPOCH2TM(p->start, &tm);
+/*
+ * Format the strong entity tag of "tag" as represented for this
+ * request.
+ */
+static void
+http_etag(const struct kreq *r, 
+	const struct tag *tag, char *buf, size_t sz)
+{
 
-	if (r->nhash != NULL &&
-   	    strcmp(r->nhash, p->fetchhead))
-		khtml_attr(&r->html, KELEM_DIV,
-			KATTR_CLASS, "row notnewest", KATTR__MAX);
+	if (tag->day != 0)
+		snprintf(buf, sz, "\"%" PRId64 "-%zu-%lld%s\"", 
+			tag->id, r->mime, (long long)tag->day,
+			http_gzip(r) ? "-gzip" : "");
 	else
-		khtml_attr(&r->html, KELEM_DIV,
-			KATTR_CLASS, "row", KATTR__MAX);
-
-	khtml_attr(&r->html, KELEM_DIV, KATTR_CLASS, 
-		"cell report-passfail", KATTR__MAX);
-	khtml_attr(&r->html, KELEM_SPAN, KATTR_CLASS, 
-		p->distcheck ? "report-pass" : "report-fail",
-		KATTR__MAX);
-	khtml_ncr(&r->html, p->distcheck ? 0x2714 : 0x2717);
-	khtml_closeelem(&r->html, 1); /* span */
-	khtml_closeelem(&r->html, 1); /* cell */
-
-	khtml_attr(&r->html, KELEM_DIV, KATTR_CLASS, 
-		"cell report-id", KATTR__MAX);
-	khtml_attr(&r->html, KELEM_A,
-		KATTR_HREF, urlid, KATTR__MAX);
-	if (p->id < 1000)
-		khtml_int(&r->html, 0);
-	if (p->id < 100)
-		khtml_int(&r->html, 0);
-	if (p->id < 10)
-		khtml_int(&r->html, 0);
-	khtml_int(&r->html, p->id);
-	khtml_closeelem(&r->html, 1); /* link */
-	khtml_closeelem(&r->html, 1); /* cell */
-
-	khtml_attr(&r->html, KELEM_DIV, KATTR_CLASS, 
-		"cell report-commit", KATTR__MAX);
-	khtml_attr(&r->html, KELEM_A, KATTR_HREF, 
-		urlcommit, KATTR__MAX);
-	strlcpy(commitshort, p->fetchhead, sizeof(commitshort));
-	khtml_puts(&r->html, commitshort);
-	khtml_closeelem(&r->html, 1); /* a */
-	khtml_closeelem(&r->html, 1); /* cell */
-
-	khtml_attr(&r->html, KELEM_DIV, KATTR_CLASS, 
-		"cell report-start", KATTR__MAX);
-	khtml_attr(&r->html, KELEM_A,
-		KATTR_HREF, urldate, KATTR__MAX);
-	khtml_attrx(&r->html, KELEM_TIME,
-		KATTR_DATETIME, KATTRX_INT, p->start, KATTR__MAX);
-	khtml_int(&r->html, tm.tm_year + 1900);
-	khtml_puts(&r->html, "-");
-	if (tm.tm_mon < 9)
-		khtml_int(&r->html, 0);
-	khtml_int(&r->html, tm.tm_mon + 1);
-	khtml_puts(&r->html, "-");
-	if (tm.tm_mday < 10)
-		khtml_int(&r->html, 0);
-	khtml_int(&r->html, tm.tm_mday);
-	khtml_closeelem(&r->html, 1); /* time */
-	khtml_closeelem(&r->html, 1); /* a */
-	khtml_closeelem(&r->html, 1); /* cell */
-
-	khtml_attr(&r->html, KELEM_DIV, KATTR_CLASS, 
-		"cell project-name", KATTR__MAX);
-	khtml_attr(&r->html, KELEM_A, 
-		KATTR_HREF, urlproj, KATTR__MAX);
-	khtml_puts(&r->html, p->project.name);
-	khtml_closeelem(&r->html, 1); /* a */
-	khtml_closeelem(&r->html, 1); /* cell */
-
-	khtml_attr(&r->html, KELEM_DIV, KATTR_CLASS, 
-		"cell report-system", KATTR__MAX);
-	khtml_attr(&r->html, KELEM_A, 
-		KATTR_HREF, urluname, KATTR__MAX);
-	get_html_uname(&r->html, p);
-	khtml_closeelem(&r->html, 1); /* a */
-	khtml_closeelem(&r->html, 1); /* cell */
+		snprintf(buf, sz, "\"%" PRId64 "-%zu%s\"", 
+			tag->id, r->mime, http_gzip(r) ? "-gzip" : "");
+}
 
-	khtml_attr(&r->html, KELEM_DIV,
-		KATTR_CLASS, "cellgroup", KATTR__MAX);
-	get_html_offs(&r->html, "cell "
-		"report-env", p->start, p->env);
-	get_html_offs(&r->html, "cell "
-		"report-deps", p->env, p->depend);
-	get_html_offs(&r->html, "cell "
-		"report-build", p->depend, p->build);
-	get_html_offs(&r->html, "cell "
-		"report-regress", p->build, p->test);
-	get_html_offs(&r->html, "cell "
-		"report-install", p->test, p->install);
-	get_html_offs(&r->html, "cell "
-		"report-dist", p->install, p->distcheck);
-	khtml_closeelem(&r->html, 1); /* cellgroup */
+/*
+ * Emit the headers of our HTTP document, but not start its body.
+ * If mime isn't KMIME__MAX, use its content type.
+ * If tag is not NULL and has a report, use it for the entity tag and
+ * (if non-zero) last-modified time.
+ * Documents with either may be compressed and have entity tags that
+ * depend on it (see http_etag()), so they vary by Accept-Encoding.
+ */
+static void
+http_head(struct kreq *r,
+	enum khttp code, enum kmime mime, const struct tag *tag)
+{
+	char	datebuf[32], etag[64];
 
-	khtml_closeelem(&r->html, 1); /* row */
-	free(urlid);
-	free(urlproj);
-	free(urldate);
-	free(urlcommit);
-	free(urluname);
+	khttp_head(r, kresps[KRESP_STATUS], "%s", khttps[code]);
+	timing_head(r, code);
+	if (mime != KMIME__MAX)
+		khttp_head(r, kresps[KRESP_CONTENT_TYPE], 
+			"%s", kmimetypes[mime]);
+	if (mime != KMIME__MAX || tag != NULL)
+		khttp_head(r, kresps[KRESP_VARY], "Accept-Encoding");
+	if (tag != NULL && tag->id != 0) {
+		http_etag(r, tag, etag, sizeof(etag));
+		khttp_head(r, kresps[KRESP_ETAG], "%s", etag);
+	}
+	if (tag != NULL && tag->id != 0 && tag->mtime != 0) {
+		kutil_epoch2str(tag->mtime, datebuf, sizeof(datebuf));
+		khttp_head(r, kresps[KRESP_LAST_MODIFIED], 
+			"%s", datebuf);
+	}
 }
 
 /*
- * Output only the log (which may be zero-length).
+ * Open our HTTP document by emitting all headers (see http_head()).
  */
 static void
-get_single_text(struct kreq *r, const struct report *p)
+http_open(struct kreq *r,
+	enum khttp code, enum kmime mime, const struct tag *tag)
 {
 
-	khttp_puts(r, p->log);
+	http_head(r, code, mime, tag);
+	khttp_body(r);
 }
 
 /*
- * List a single record as text/html.
+ * Whether the request is conditional on its cache validators.
  */
-static void
-get_single_html(struct kreq *r, const struct report *p)
+static int
+http_conditional(const struct kreq *r)
 {
-	struct khtmlreq	 req;
-	char		 buf[64];
-	char		 commitshort[8];
-	char		*url = NULL, *urlcommit, *urlproj, *urluname;
-	const char	*cp;
-	size_t		 count;
 
-	urlproj = khttp_urlpartx(r->pname, 
-		ksuffixes[KMIME_TEXT_HTML],
-		pages[PAGE_INDEX],
-		valid_keys[VALID_PROJECT_NAME].name,
-		KATTRX_STRING, p->project.name, NULL);
-	kasprintf(&urlcommit, "%s/%s/tree/%s",
-		COMMIT_BASE, p->project.name,
-		p->fetchhead);
-	urluname = khttp_urlpart(r->pname,
-		ksuffixes[KMIME_TEXT_HTML],
-		pages[PAGE_INDEX],
-		valid_keys[VALID_REPORT_UNAMEHASH].name,
-		p->unamehash, NULL);
+	return r->method == KMETHOD_GET &&
+		(r->reqmap[KREQU_IF_NONE_MATCH] != NULL ||
+		 r->reqmap[KREQU_IF_MODIFIED_SINCE] != NULL);
+}
 
-	khtml_open(&req, r, 0);
-	kcgi_writer_disable(r);
-	html_open(&req, "Report");
+/*
+ * If the client's copy is still good according to "tag", emit HTTP 304
+ * and return non-zero.
+ * As per RFC 7232, If-Modified-Since is ignored if If-None-Match was
+ * given, which is matched weakly (so ignoring W/).
+ */
+static int
+http_fresh(struct kreq *r, const struct tag *tag)
+{
+	const struct kheader	*kh;
+	struct tm		 tm;
+	char			 etag[64];
+	time_t			 t;
+
+	if (!http_conditional(r) || tag->id == 0)
+		return 0;
+
+	if ((kh = r->reqmap[KREQU_IF_NONE_MATCH]) != NULL) {
+		http_etag(r, tag, etag, sizeof(etag));
+		if (strcmp(kh->val, "*") && strstr(kh->val, etag) == NULL)
+			return 0;
+	} else {
+		kh = r->reqmap[KREQU_IF_MODIFIED_SINCE];
+		memset(&tm, 0, sizeof(struct tm));
+		if (strptime(kh->val, "%a, %d %b %Y %T GMT", &tm) == NULL ||
+		    (t = timegm(&tm)) == -1 || tag->mtime > t)
+			return 0;
+	}
 
-	/* Heading. */
+	http_open(r, KHTTP_304, r->mime, tag);
+	return 1;
+}
 
-	khtml_elem(&req, KELEM_HEADER);
-	khtml_attr(&req, KELEM_H1,
-		KATTR_CLASS, "singleton", KATTR__MAX);
-	khtml_attr(&req, KELEM_A, 
-		KATTR_HREF, "index.html", KATTR__MAX);
-	khtml_puts(&req, "Dashboard");
-	khtml_closeelem(&req, 1); /* a */
-	khtml_ncr(&req, 0x203a);
-	khtml_elem(&req, KELEM_SPAN);
-	khtml_puts(&req, "Reports");
-	khtml_closeelem(&req, 1); /* span */
-	khtml_ncr(&req, 0x203a);
-	khtml_attr(&req, KELEM_SPAN,
-		KATTR_CLASS, "report-id", KATTR__MAX);
-	if (p->id < 1000)
-		khtml_int(&req, 0);
-	if (p->id < 100)
-		khtml_int(&req, 0);
-	if (p->id < 10)
-		khtml_int(&req, 0);
-	khtml_int(&req, p->id);
-	khtml_closeelem(&req, 1); /* span */
-	khtml_closeelem(&req, 1); /* h1 */
-	khtml_closeelem(&req, 1); /* header */
+/*
+ * Parse the single byte range requested (RFC 7233) of a document of
+ * "size" bytes whose validators are "tag".
+ * Multiple ranges, malformed ranges, and ranges conditional on a
+ * different entity tag (If-Range) are ignored, as the RFC allows.
+ * Returns -1 if the whole document should be sent, 0 if the range is
+ * unsatisfiable, or 1 if "first" and "last" (inclusive) are set.
+ */
+static int
+http_range(const struct kreq *r, const struct tag *tag, int64_t size,
+	int64_t *first, int64_t *last)
+{
+	const struct kheader	*kh;
+	const char		*cp;
+	char			*ep;
+	char			 etag[64];
+	long long		 a, b;
+
+	if (r->method != KMETHOD_GET ||
+	    (kh = r->reqmap[KREQU_RANGE]) == NULL)
+		return -1;
+
+	if (r->reqmap[KREQU_IF_RANGE] != NULL) {
+		http_etag(r, tag, etag, sizeof(etag));
+		if (strcmp(r->reqmap[KREQU_IF_RANGE]->val, etag))
+			return -1;
+	}
 
-	/* Body. */
+	if (strncmp(kh->val, "bytes=", 6) || 
+	    strchr(kh->val, ',') != NULL)
+		return -1;
+	cp = kh->val + 6;
+
+	/* A suffix range ("-n") is the last bytes. */
+
+	if (*cp == '-') {
+		if (!isdigit((unsigned char)cp[1]))
+			return -1;
+		errno = 0;
+		b = strtoll(cp + 1, &ep, 10);
+		if (*ep != '\0' || errno == ERANGE)
+			return -1;
+		if (b == 0 || size == 0)
+			return 0;
+		*first = b >= size ? 0 : size - b;
+		*last = size - 1;
+		return 1;
+	}
 
-	khtml_attr(&req, KELEM_DIV,
-		KATTR_CLASS, "singleton", KATTR__MAX);
-	khtml_attr(&req, KELEM_SPAN, KATTR_CLASS, 
-		"lefthead report-id", KATTR__MAX);
-	if (p->id < 1000)
-		khtml_int(&req, 0);
-	if (p->id < 100)
-		khtml_int(&req, 0);
-	if (p->id < 10)
-		khtml_int(&req, 0);
-	khtml_int(&req, p->id);
-	khtml_closeelem(&req, 1); /* div */
+	if (!isdigit((unsigned char)*cp))
+		return -1;
+	errno = 0;
+	a = strtoll(cp, &ep, 10);
+	if (*ep != '-' || errno == ERANGE)
+		return -1;
+	cp = ep + 1;
+
+	if (*cp == '\0')
+		b = size - 1;
+	else if (!isdigit((unsigned char)*cp))
+		return -1;
+	else if ((b = strtoll(cp, &ep, 10)) < a || 
+	    *ep != '\0' || errno == ERANGE)
+		return -1;
+
+	if (a >= size)
+		return 0;
+	*first = a;
+	*last = b >= size ? size - 1 : b;
+	return 1;
+}
 
-	khtml_attr(&req, KELEM_SPAN, KATTR_CLASS, 
-		"lefthead project-name", KATTR__MAX);
-	khtml_attr(&req, KELEM_A, KATTR_HREF, urlproj, KATTR__MAX);
-	khtml_puts(&req, p->project.name);
-	khtml_closeelem(&req, 1); /* a */
-	khtml_closeelem(&req, 1); /* span */
+/*
+ * Look up a field not known to ORT by its name and return the first
+ * one passing "valid", or NULL if there are none.
+ */
+static struct kpair *
+field_get(struct kreq *r, const char *key, int (*valid)(struct kpair *))
+{
+	size_t	 i;
 
-	khtml_attr(&req, KELEM_SPAN, KATTR_CLASS, 
-		"lefthead project-repo", KATTR__MAX);
-	khtml_attr(&req, KELEM_A, KATTR_CLASS, 
-		"lefthead report-commit", 
-		KATTR_HREF, urlcommit, KATTR__MAX);
-	strlcpy(commitshort, p->fetchhead, sizeof(commitshort));
-	khtml_puts(&req, commitshort);
-	khtml_closeelem(&req, 1); /* a */
-	khtml_closeelem(&req, 1); /* span */
+	for (i = 0; i < r->fieldsz; i++)
+		if (strcmp(r->fields[i].key, key) == 0 &&
+		    valid(&r->fields[i]))
+			return &r->fields[i];
 
-	khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
-		"lefthead report-start", KATTR__MAX);
-	khtml_attrx(&req, KELEM_TIME,
-		KATTR_DATETIME, KATTRX_INT, 
-		p->start, KATTR__MAX);
-	kutil_epoch2str(p->start, buf, sizeof(buf));
-	khtml_puts(&req, buf);
-	khtml_closeelem(&req, 1); /* time */
-	khtml_closeelem(&req, 1); /* div */
+	return NULL;
+}
 
-	khtml_attr(&req, KELEM_DIV, KATTR_CLASS,
-		"lefthead report-system", KATTR__MAX);
-	khtml_attr(&req, KELEM_A, 
-		KATTR_HREF, urluname, KATTR__MAX);
-	get_html_uname(&req, p);
-	khtml_closeelem(&req, 1); /* a */
-	khtml_closeelem(&req, 1); /* div */
+/*
+ * Allocate "sz" bytes of string from the arena of the current request,
+ * which are freed along with all others by arena_free().
+ * Strings are allocated one after the other within blocks of ARENASZ,
+ * or one of their own if larger.
+ * This never returns NULL.
+ */
+static char *
+arena_alloc(size_t sz)
+{
+	struct arenablk	*b;
+	char		*cp;
 
-	khtml_attr(&req, KELEM_DIV, KATTR_CLASS,
-		"lefthead report-system-ext", KATTR__MAX);
-	khtml_puts(&req, p->unamev);
-	khtml_closeelem(&req, 1); /* div */
+	if (arena == NULL || arena->sz - arena->used < sz) {
+		b = kmalloc(sizeof(struct arenablk) + 
+			(sz > ARENASZ ? sz : ARENASZ));
+		b->sz = sz > ARENASZ ? sz : ARENASZ;
+		b->used = 0;
+		b->next = arena;
+		arena = b;
+	}
 
-	khtml_attr(&req, KELEM_DIV,
-		KATTR_CLASS, "leftgroup", KATTR__MAX);
-	get_html_offs(&req, "lefthead "
-		"report-env", p->start, p->env);
-	get_html_offs(&req, "lefthead "
-		"report-deps", p->env, p->depend);
-	get_html_offs(&req, "lefthead "
-		"report-build", p->depend, p->build);
-	get_html_offs(&req, "lefthead "
-		"report-regress", p->build, p->test);
-	get_html_offs(&req, "lefthead "
-		"report-install", p->test, p->install);
-	get_html_offs(&req, "lefthead "
-		"report-dist", p->install, p->distcheck);
-	khtml_closeelem(&req, 1); /* div */
+	cp = arena->buf + arena->used;
+	arena->used += sz;
+	return cp;
+}
 
-	if (p->distcheck == 0)
-		khtml_attr(&req, KELEM_DIV, KATTR_CLASS,
-			"report-failure", KATTR__MAX);
-	else
-		khtml_attr(&req, KELEM_DIV, KATTR_CLASS,
-			"report-success", KATTR__MAX);
-	khtml_closeelem(&req, 1); /* div */
+/*
+ * Like kasprintf(), but allocated from the arena and not freed.
+ */
+static char *
+arena_printf(const char *fmt, ...)
+{
+	va_list		 ap;
+	int		 len;
+	size_t		 sz;
+	char		*cp;
 
-	/* Emit the log tail only if it's non-empty. */
+	/* Try to print directly into what's left of the block. */
 
-	if (p->log[0] != '\0') {
-		khtml_attr(&req, KELEM_DIV, KATTR_CLASS,
-			"report-log-box", KATTR__MAX);
-		khtml_attr(&req, KELEM_DIV, KATTR_CLASS,
-			"report-log", KATTR__MAX);
-		count = 0;
-		cp = p->log + strlen(p->log);
-		while (cp > p->log) {
-			if (*cp == '\n' && count++ == 16) {
-				cp++;
-				break;
-			}
-			cp--;
-		}
-		khtml_puts(&req, cp);
-		khtml_closeelem(&req, 1); /* div */
-		url = khttp_urlpartx(r->pname, 
-			ksuffixes[KMIME_TEXT_PLAIN],
-			pages[PAGE_INDEX],
-			valid_keys[VALID_REPORT_ID].name,
-			KATTRX_INT, p->id, NULL);
-		khtml_attr(&req, KELEM_A, 
-			KATTR_CLASS, "report-log-link", 
-			KATTR_HREF, url, KATTR__MAX);
-		khtml_closeelem(&req, 1); /* a */
-		khtml_closeelem(&req, 1); /* div */
-	}
+	sz = arena == NULL ? 0 : arena->sz - arena->used;
+	cp = arena == NULL ? NULL : arena->buf + arena->used;
+	va_start(ap, fmt);
+	len = vsnprintf(cp, sz, fmt, ap);
+	va_end(ap);
 
-	khtml_closeelem(&req, 1); /* div */
-	khtml_elem(&req, KELEM_FOOTER);
-	khtml_attr(&req, KELEM_A,
-		KATTR_HREF, REPO_BASE "/minci", KATTR__MAX);
-	khtml_puts(&req, "minci");
-	khtml_closeelem(&req, 1); /* a */
-	khtml_closeelem(&req, 1); /* footer */
-	khtml_closeelem(&req, 1); /* body */
-	khtml_closeelem(&req, 1); /* html */
-	khtml_close(&req);
-	free(url);
-	free(urlproj);
-	free(urluname);
-	free(urlcommit);
+	if (len == -1)
+		err(EXIT_FAILURE, "vsnprintf");
+	if ((size_t)len < sz)
+		return arena_alloc(len + 1);
+
+	cp = arena_alloc(len + 1);
+	va_start(ap, fmt);
+	vsnprintf(cp, len + 1, fmt, ap);
+	va_end(ap);
+	return cp;
 }
 
 /*
- * Routes a record to its MIME type output.
- * Outputs HTTP 404 (error) or 200 (success).
+ * Free all strings of the arena at the end of a request.
+ * One block is kept for the next request, if there is one, so
+ * persistent workers needn't allocate again.
  */
 static void
-get_single(struct kreq *r, time_t mtime)
+arena_free(void)
 {
-	struct report	*p;
-	struct kpair	*kp;
-
-	kp = r->fieldmap[VALID_REPORT_ID];
-	assert(kp != NULL);
-
-	p = db_report_get_byid(r->arg, 
-		kp->parsed.i); /* id */
-
-	if (p == NULL) {
-		http_open(r, KHTTP_404, KMIME__MAX, mtime);
-		return;
+	struct arenablk	*b, *keep = NULL;
+
+	while ((b = arena) != NULL) {
+		arena = b->next;
+		if (keep == NULL && b->sz == ARENASZ)
+			keep = b;
+		else
+			free(b);
 	}
 
-	/* Emit either our log or the full HTML record. */
+	if ((arena = keep) != NULL) {
+		arena->next = NULL;
+		arena->used = 0;
+	}
+}
 
-	http_open(r, KHTTP_200, r->mime, mtime);
-	if (r->mime == KMIME_TEXT_PLAIN)
-		get_single_text(r, p);
-	else
-		get_single_html(r, p);
+/*
+ * Append "cp" URL-encoded to "buf" as khttp_urlencode() would, but
+ * with spaces as "%20", so it may also be a file name of a path.
+ */
+static void
+url_encode(struct kcgi_buf *buf, const char *cp)
+{
 
-	db_report_free(p);
+	for ( ; *cp != '\0'; cp++)
+		if (isalnum((unsigned char)*cp) || *cp == '-' || 
+		    *cp == '_' || *cp == '.' || *cp == '~')
+			kcgi_buf_putc(buf, *cp);
+		else
+			kcgi_buf_printf(buf, "%%%.2X", 
+				(unsigned char)*cp);
 }
 
 /*
- * List the last *n* records, sorted by time of accept.
- * Always outputs HTTP 200.
+ * Like khttp_urlpartx(), but allocated from the arena and not freed.
+ * The variable arguments are triplets of a key, KATTRX_STRING or
+ * KATTRX_INT, and the value, ending with a NULL key.
  */
-static void
-get_dash(struct kreq *r, time_t mtime)
+static char *
+url_partx(const char *path, const char *suffix, const char *page, ...)
 {
-	struct khtmlreq	 req;
-	struct report_q	*rq;
-	struct report	*rn;
-	struct dash	*dash = NULL, *curdash;
-	size_t		 i, dashsz = 0, maxdone = 0;
-	struct tm	 tm;
-	char		*urlproj, *urlcommit;
-	char		 datebuf[32], commitshort[8];
+	va_list		 ap;
+	const char	*key;
+	char		*cp;
+	int		 first = 1;
+
+	urlbuf.sz = 0;
+	kcgi_buf_printf(&urlbuf, "%s/%s.%s", path, page, suffix);
+
+	va_start(ap, page);
+	while ((key = va_arg(ap, const char *)) != NULL) {
+		kcgi_buf_putc(&urlbuf, first ? '?' : '&');
+		first = 0;
+		url_encode(&urlbuf, key);
+		kcgi_buf_putc(&urlbuf, '=');
+		if (va_arg(ap, enum kattrx) == KATTRX_INT)
+			kcgi_buf_printf(&urlbuf, 
+				"%" PRId64, va_arg(ap, int64_t));
+		else
+			url_encode(&urlbuf, va_arg(ap, const char *));
+	}
+	va_end(ap);
 
-	/* Open output page. */
+	cp = arena_alloc(urlbuf.sz + 1);
+	memcpy(cp, urlbuf.buf, urlbuf.sz);
+	cp[urlbuf.sz] = '\0';
+	return cp;
+}
 
-	http_open(r, KHTTP_200, r->mime, mtime);
-	khtml_open(&req, r, 0);
-	kcgi_writer_disable(r);
-	html_open(&req, "Reports");
+/*
+ * Whether the project "name" may name a rendered page: it must be a
+ * single path component that isn't hidden.
+ */
+static int
+render_name(const char *name)
+{
 
-	/* Output header. */
+	return name[0] != '\0' && name[0] != '.' &&
+		strchr(name, '/') == NULL;
+}
 
-	khtml_elem(&req, KELEM_HEADER);
-	khtml_attr(&req, KELEM_H1, 
-		KATTR_CLASS, "table", KATTR__MAX);
+/*
+ * URL of a report (if "key" is VALID_REPORT_ID) or of the listing
+ * scoped by the ORT field "key", whose value is "s" if not NULL, else
+ * "i".
+ * While rendering, these are the rendered pages, named as the scopes in
+ * scope_get(), else the CGI program's.
+ * The URL is allocated from the arena.
+ */
+static char *
+url_index(const struct kreq *r, size_t key, const char *s, int64_t i)
+{
+	const char	*dir;
+
+	if (rendering && (s == NULL || render_name(s))) {
+		if (key == VALID_REPORT_ID)
+			dir = "report";
+		else if (key == VALID_PROJECT_NAME)
+			dir = "project";
+		else if (key == VALID_REPORT_MACHINEID)
+			dir = "machine";
+		else
+			dir = "date";
+		if (s == NULL)
+			return arena_printf(STATICURL 
+				"/%s/%" PRId64 ".html", dir, i);
+		urlbuf.sz = 0;
+		url_encode(&urlbuf, s);
+		return arena_printf(STATICURL "/%s/%.*s.html", 
+			dir, (int)urlbuf.sz, urlbuf.buf);
+	}
 
-	khtml_elem(&req, KELEM_SPAN);
-	khtml_puts(&req, "Dashboard");
-	khtml_closeelem(&req, 1); /* span */
-	khtml_ncr(&req, 0x203a);
-	khtml_elem(&req, KELEM_SPAN);
-	khtml_puts(&req, "All Projects");
-	khtml_closeelem(&req, 1); /* span */
-	khtml_closeelem(&req, 1); /* h1 */
-	khtml_closeelem(&req, 1); /* header */
+	if (s != NULL)
+		return url_partx(r->pname, 
+			ksuffixes[KMIME_TEXT_HTML],
+			pages[PAGE_INDEX],
+			valid_keys[key].name, KATTRX_STRING, s, NULL);
 
-	/* Output data. */
+	return url_partx(r->pname, 
+		ksuffixes[KMIME_TEXT_HTML],
+		pages[PAGE_INDEX],
+		valid_keys[key].name, KATTRX_INT, i, NULL);
+}
 
-	khtml_attr(&req, KELEM_DIV, 
-		KATTR_CLASS, "table alltable", KATTR__MAX);
+/*
+ * Start assembling markup for "r".
+ * This must be called before kcgi_writer_disable().
+ */
+static void
+hbuf_open(struct hbuf *h, struct kreq *r)
+{
 
-	rq = db_report_list_dash(r->arg);
+	memset(h, 0, sizeof(struct hbuf));
+	h->w = kcgi_writer_get(r, 0);
+	h->b.growsz = HBUFSZ;
+}
 
-	/* Establish the newest report hash. */
+/*
+ * Write out the markup assembled so far.
+ */
+static void
+hbuf_flush(struct hbuf *h)
+{
 
-	TAILQ_FOREACH(rn, rq, _entries) {
-		for (i = 0; i < dashsz; i++)
-			if (dash[i].proj->id == rn->projectid)
-				break;
+	if (h->b.sz > 0)
+		kcgi_writer_write(h->w, h->b.buf, h->b.sz);
+	timing.bytes += h->b.sz;
+	h->b.sz = 0;
+}
 
-		if (i == dashsz) {
-			dash = kreallocarray(dash, 
-				dashsz + 1, sizeof(struct dash));
-			dashsz++;
-			curdash = &dash[i];
-			memset(curdash, 0, sizeof(struct dash));
-			curdash->proj = &rn->project;
-			curdash->nhash = rn->fetchhead;
-			curdash->nctime = rn->ctime;
-		} else
-			curdash = &dash[i];
+/*
+ * Write out any remaining markup and free the buffer.
+ */
+static void
+hbuf_close(struct hbuf *h)
+{
 
-		if (rn->ctime > curdash->nctime) {
-			curdash->nhash = rn->fetchhead;
-			curdash->nctime = rn->ctime;
+	hbuf_flush(h);
+	kcgi_writer_free(h->w);
+	free(h->b.buf);
+}
+
+/*
+ * Append "cp" to the markup of "h", escaped as khtml_puts() would.
+ */
+static void
+hbuf_puts(struct hbuf *h, const char *cp)
+{
+	size_t	 sz;
+
+	for (;;) {
+		sz = strcspn(cp, "<>&\"'");
+		kcgi_buf_write(cp, sz, &h->b);
+		cp += sz;
+		switch (*cp) {
+		case '\0':
+			return;
+		case '<':
+			HBUF_BLOB(h, "&lt;");
+			break;
+		case '>':
+			HBUF_BLOB(h, "&gt;");
+			break;
+		case '&':
+			HBUF_BLOB(h, "&amp;");
+			break;
+		case '"':
+			HBUF_BLOB(h, "&quot;");
+			break;
+		default:
+			HBUF_BLOB(h, "&#39;");
+			break;
 		}
+		cp++;
 	}
+}
 
-	/* 
-	 * Compute how many have completed the newest hash.
-	 * The empty hash is always considered old.
-	 */
+/*
+ * Write our HTML document's type, envelope, and header element, leaving
+ * the body envelope open for khtml(3).
+ * These are the same for all pages but for the title.
+ */
+static void
+html_open(struct hbuf *h, const char *title)
+{
 
-	TAILQ_FOREACH(rn, rq, _entries) {
-		for (i = 0; i < dashsz; i++)
-			if (dash[i].proj->id == rn->projectid)
-				break;
-		assert(i < dashsz);
-		if (dash[i].nhash[0] != '\0' &&
-		    strcmp(rn->fetchhead, dash[i].nhash) == 0) {
-			if (++dash[i].finished > maxdone)
-				maxdone = dash[i].finished;
-			dash[i].success += rn->distcheck != 0;
-		} else {
-			dash[i].pending++;
-		}
-	}
+	HBUF_BLOB(h, 
+		"<!DOCTYPE html>"
+		"<html>"
+		"<head>"
+		"<title>Minimal CI: ");
+	hbuf_puts(h, title);
+	HBUF_BLOB(h, 
+		"</title>"
+		"<meta name=\"viewport\" "
+		 "content=\"width=device-width, initial-scale=1\">"
+		"<meta charset=\"utf-8\">"
+		"<link rel=\"stylesheet\" href=\"/minci.css\">"
+		"</head>"
+		"<body>");
+	hbuf_flush(h);
+}
 
-	/* Header row. */
+/*
+ * Finish the document begun with html_open() with the footer, then
+ * close the buffer.
+ * All elements opened with khtml(3) must have been closed.
+ */
+static void
+html_close(struct hbuf *h)
+{
 
+	HBUF_BLOB(h, 
+		"<footer>"
+		"<a href=\"" REPO_BASE "/minci\">minci</a>"
+		"</footer>"
+		"</body>"
+		"</html>");
+	hbuf_close(h);
+}
+
+/*
+ * Format the uname fields to have useful (and short) output.
+ */
+static void
+get_html_uname(struct khtmlreq *req, const struct report *p)
+{
+
+	khtml_puts(req, p->machine.unames);
+	khtml_puts(req, " ");
+	khtml_puts(req, p->machine.unamer);
+	khtml_puts(req, " ");
+	khtml_puts(req, p->machine.unamem);
+}
+
+/*
+ * Print a block with a time offset of "start" to "given".
+ * If "given" is zero, suppress any content printing.
+ * If "m" is not NULL, follow the offset with the stage's resource
+ * usage.
+ */
+static void
+get_html_offs(struct khtmlreq *req, const char *classes,
+	int64_t start, int64_t given, const struct stagemetrics *m)
+{
+	char	 buf[128];
+
+	khtml_attr(req, KELEM_DIV,
+		KATTR_CLASS, classes, KATTR__MAX);
+	if (given != 0) {
+		khtml_attrx(req, KELEM_TIME, 
+			KATTR_CLASS, KATTRX_STRING, "success",
+			KATTR_DATETIME, KATTRX_INT, given, 
+			KATTR__MAX);
+		khtml_int(req, given - start);
+		khtml_closeelem(req, 1); /* time */
+		if (m != NULL) {
+			snprintf(buf, sizeof(buf), 
+				"%" PRId64 ".%03" PRId64 " s wall, "
+				"%" PRId64 ".%03" PRId64 " s user, "
+				"%" PRId64 ".%03" PRId64 " s sys, "
+				"%" PRId64 " KB rss, "
+				"%" PRId64 "/%" PRId64 " blocks in/out",
+				m->wall / 1000, m->wall % 1000,
+				m->utime / 1000, m->utime % 1000,
+				m->stime / 1000, m->stime % 1000,
+				m->maxrss, m->inblock, m->oublock);
+			khtml_attr(req, KELEM_SMALL, KATTR_CLASS,
+				"report-metrics", KATTR__MAX);
+			khtml_puts(req, buf);
+			khtml_closeelem(req, 1); /* small */
+		}
+	} else {
+		khtml_attr(req, KELEM_SPAN, 
+			KATTR_CLASS, "fail", KATTR__MAX);
+		khtml_closeelem(req, 1); /* span */
+	}
+	khtml_closeelem(req, 1); /* div */
+}
+
+/*
+ * Print the first row of a report table.
+ */
+static void
+get_html_last_header(struct hbuf *h)
+{
+
+	HBUF_BLOB(h, 
+		"<div class=\"row\">"
+		"<div class=\"head report-passfail\"></div>"
+		"<div class=\"head report-id\"></div>"
+		"<div class=\"head report-commit\"></div>"
+		"<div class=\"head report-start\"></div>"
+		"<div class=\"head project-name\"></div>"
+		"<div class=\"head report-system\"></div>"
+		"<div class=\"cellgroup\">"
+		"<div class=\"head report-env\"></div>"
+		"<div class=\"head report-deps\"></div>"
+		"<div class=\"head report-build\"></div>"
+		"<div class=\"head report-regress\"></div>"
+		"<div class=\"head report-install\"></div>"
+		"<div class=\"head report-dist\"></div>"
+		"</div>"
+		"</div>");
+}
+
+/*
+ * Like get_html_offs() but for rows of a listing, so without resource
+ * usage.
+ */
+static void
+get_html_row_offs(struct hbuf *h, const char *classes,
+	int64_t start, int64_t given)
+{
+
+	HBUF_BLOB(h, "<div class=\"");
+	kcgi_buf_puts(&h->b, classes);
+	if (given != 0)
+		kcgi_buf_printf(&h->b, "\">"
+			"<time class=\"success\" datetime=\"%" PRId64 "\">"
+			"%" PRId64 "</time></div>", given, given - start);
+	else
+		HBUF_BLOB(h, "\"><span class=\"fail\"></span></div>");
+}
+
+/*
+ * Account for a row of a page of a listing.
+ * Returns zero if the row is beyond the page and must be skipped,
+ * non-zero if it should be shown.
+ */
+static int
+page_row(struct req *r, const struct report *p)
+{
+
+	if (r->count == r->max) {
+		r->more = 1;
+		return 0;
+	}
+	timing.rows++;
+	if (r->count++ == 0)
+		r->first = p->id;
+	r->last = p->id;
+	return 1;
+}
+
+/*
+ * Print a record as it would appear in an HTML table.
+ * The row is assembled with the others and written once there's enough.
+ */
+static void
+get_html_last_report(const struct report *p, void *arg)
+{
+	struct req	*r = arg;
+	struct hbuf	*h = &r->hb;
+	struct tm	 tm;
+	int64_t		 date;
+	char		*urlid, *urlproj, *urldate, *urlcommit, 
+			*urluname;
+	char		 commitshort[8];
+
+	if (!page_row(r, p))
+		return;
+
+	memset(&tm, 0, sizeof(struct tm));
+	KUTIL_EPOCH2TM(p->ctime, &tm);
+	date = kutil_date2epoch
+		(tm.tm_mday, tm.tm_mon + 1, tm.tm_year + 1900);
+
+	urlid = url_index(r->r, VALID_REPORT_ID, NULL, p->id);
+	urlproj = url_index(r->r, 
+		VALID_PROJECT_NAME, p->project.name, 0);
+	urldate = url_index(r->r, VALID_REPORT_CTIME, NULL, date);
+	urlcommit = arena_printf("%s/%s/tree/%s",
+		COMMIT_BASE, p->project.name,
+		p->revision.hash);
+	urluname = url_index(r->r, 
+		VALID_REPORT_MACHINEID, NULL, p->machineid);
+
+	memset(&tm, 0, sizeof(struct tm));
+	KUTIL_EPOCH2TM(p->start, &tm);
+
+	if (r->nrevision != 0 && r->nrevision != p->revisionid)
+		HBUF_BLOB(h, "<div class=\"row notnewest\">");
+	else
+		HBUF_BLOB(h, "<div class=\"row\">");
+
+	if (p->distcheck)
+		HBUF_BLOB(h, "<div class=\"cell report-passfail\">"
+			"<span class=\"report-pass\">&#x2714;</span>"
+			"</div>");
+	else
+		HBUF_BLOB(h, "<div class=\"cell report-passfail\">"
+			"<span class=\"report-fail\">&#x2717;</span>"
+			"</div>");
+
+	HBUF_BLOB(h, "<div class=\"cell report-id\"><a href=\"");
+	hbuf_puts(h, urlid);
+	kcgi_buf_printf(&h->b, "\">%04" PRId64 "</a></div>", p->id);
+
+	HBUF_BLOB(h, "<div class=\"cell report-commit\"><a href=\"");
+	hbuf_puts(h, urlcommit);
+	HBUF_BLOB(h, "\">");
+	strlcpy(commitshort, p->revision.hash, sizeof(commitshort));
+	hbuf_puts(h, commitshort);
+	HBUF_BLOB(h, "</a></div>");
+
+	HBUF_BLOB(h, "<div class=\"cell report-start\"><a href=\"");
+	hbuf_puts(h, urldate);
+	kcgi_buf_printf(&h->b, "\"><time datetime=\"%" PRId64 "\">"
+		"%04d-%02d-%02d</time></a></div>", p->start,
+		tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+
+	HBUF_BLOB(h, "<div class=\"cell project-name\"><a href=\"");
+	hbuf_puts(h, urlproj);
+	HBUF_BLOB(h, "\">");
+	hbuf_puts(h, p->project.name);
+	HBUF_BLOB(h, "</a></div>");
+
+	/* As in get_html_uname(). */
+
+	HBUF_BLOB(h, "<div class=\"cell report-system\"><a href=\"");
+	hbuf_puts(h, urluname);
+	HBUF_BLOB(h, "\">");
+	hbuf_puts(h, p->machine.unames);
+	HBUF_BLOB(h, " ");
+	hbuf_puts(h, p->machine.unamer);
+	HBUF_BLOB(h, " ");
+	hbuf_puts(h, p->machine.unamem);
+	HBUF_BLOB(h, "</a></div>");
+
+	HBUF_BLOB(h, "<div class=\"cellgroup\">");
+	get_html_row_offs(h, "cell "
+		"report-env", p->start, p->env);
+	get_html_row_offs(h, "cell "
+		"report-deps", p->env, p->depend);
+	get_html_row_offs(h, "cell "
+		"report-build", p->depend, p->build);
+	get_html_row_offs(h, "cell "
+		"report-regress", p->build, p->test);
+	get_html_row_offs(h, "cell "
+		"report-install", p->test, p->install);
+	get_html_row_offs(h, "cell "
+		"report-dist", p->install, p->distcheck);
+	HBUF_BLOB(h, "</div>"); /* cellgroup */
+
+	HBUF_BLOB(h, "</div>"); /* row */
+	if (h->b.sz >= HBUFSZ)
+		hbuf_flush(h);
+
+}
+
+/*
+ * Pass a chunk of a log to the reader's callback, inflating it first
+ * if required.
+ * After an error, the remaining chunks are skipped.
+ */
+static void
+log_read_chunk(const struct logchunk *c, void *arg)
+{
+	struct logread	*lr = arg;
+	char		 buf[16384];
+	size_t		 sz;
+	int		 rc;
+
+	if (!lr->ok)
+		return;
+
+	if (!lr->inflate) {
+		lr->ok = lr->cb(c->data, c->data_sz, lr->arg);
+		return;
+	}
+
+	lr->z.next_in = (Bytef *)c->data;
+	lr->z.avail_in = c->data_sz;
+	do {
+		lr->z.next_out = (Bytef *)buf;
+		lr->z.avail_out = sizeof(buf);
+		rc = inflate(&lr->z, Z_NO_FLUSH);
+		if (rc == Z_BUF_ERROR)
+			break;
+		if (rc != Z_OK && rc != Z_STREAM_END) {
+			lr->ok = 0;
+			return;
+		}
+		if ((sz = sizeof(buf) - lr->z.avail_out) > 0 &&
+		    !lr->cb(buf, sz, lr->arg)) {
+			lr->ok = 0;
+			return;
+		}
+	} while (rc != Z_STREAM_END && lr->z.avail_out == 0);
+
+	if (rc == Z_STREAM_END)
+		lr->end = 1;
+}
+
+/*
+ * Start reading the log "lb" at chunk "seq" into "cb", which returns
+ * zero on failure and non-zero on success.
+ * The log is inflated unless "raw" is set, in which case it's passed
+ * through as stored (see logblob.enc).
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+log_read_open(struct kreq *r, struct logread *lr,
+	const struct logblob *lb, int64_t seq, int raw,
+	int (*cb)(const char *, size_t, void *), void *arg)
+{
+
+	memset(lr, 0, sizeof(struct logread));
+	lr->inflate = !raw && lb->enc == LOGENC_gzip;
+	lr->ok = 1;
+	lr->cb = cb;
+	lr->arg = arg;
+
+	/* Only the first chunk has the gzip header. */
+
+	if (lr->inflate && inflateInit2(&lr->z, 
+	    seq == 0 ? 15 + 16 : -15) != Z_OK) {
+		kutil_warnx(r, NULL, "inflateInit2");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Finish reading a log started with log_read_open().
+ * Returns zero if the stored log was corrupt or the callback failed,
+ * non-zero on success.
+ */
+static int
+log_read_close(struct kreq *r, struct logread *lr,
+	const struct logblob *lb)
+{
+
+	if (lr->inflate)
+		inflateEnd(&lr->z);
+	if (!lr->ok)
+		kutil_warnx(r, NULL, "%s: log not fully read", lb->digest);
+	return lr->ok;
+}
+
+/*
+ * Read all of the log "lb" in pieces into "cb" (see log_read_open()).
+ * Only a chunk of the log is held in memory at a time.
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+log_read(struct kreq *r, const struct logblob *lb, int raw,
+	int (*cb)(const char *, size_t, void *), void *arg)
+{
+	struct logread	 lr;
+
+	if (!log_read_open(r, &lr, lb, 0, raw, cb, arg))
+		return 0;
+	db_logchunk_iterate_byblob(r->arg, log_read_chunk, &lr,
+		lb->id); /* logblobid */
+	if (lr.inflate && !lr.end)
+		lr.ok = 0;
+	return log_read_close(r, &lr, lb);
+}
+
+/*
+ * Like log_read(), but inflating only the chunks from "seq" up to the
+ * one holding byte "last" or, if "byline", the last starting on line
+ * "last".
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+log_read_window(struct kreq *r, const struct logblob *lb, 
+	int64_t seq, int64_t last, int byline,
+	int (*cb)(const char *, size_t, void *), void *arg)
+{
+	struct logread	 lr;
+
+	if (!log_read_open(r, &lr, lb, seq, 0, cb, arg))
+		return 0;
+	if (byline)
+		db_logchunk_iterate_toline(r->arg, log_read_chunk, &lr,
+			lb->id, /* logblobid */
+			seq, /* seq */
+			last); /* line */
+	else
+		db_logchunk_iterate_tooffs(r->arg, log_read_chunk, &lr,
+			lb->id, /* logblobid */
+			seq, /* seq */
+			last); /* offs */
+	return log_read_close(r, &lr, lb);
+}
+
+/*
+ * Write a piece of a log (see log_read()) as the HTTP body "arg".
+ */
+static int
+log_write_http(const char *buf, size_t sz, void *arg)
+{
+
+	timing.bytes += sz;
+	return khttp_write(arg, buf, sz) == KCGI_OK;
+}
+
+/*
+ * Write a piece of a log (see log_read()) into the open JSON string
+ * of "arg".
+ */
+static int
+log_write_json(const char *buf, size_t sz, void *arg)
+{
+
+	timing.bytes += sz;
+	return kjson_string_write(buf, sz, arg) == KCGI_OK;
+}
+
+/*
+ * Write the part of a piece of a log within the "arg" window of bytes
+ * (see log_read_window()) as the HTTP body.
+ */
+static int
+log_write_range(const char *buf, size_t sz, void *arg)
+{
+	struct logwin	*w = arg;
+	int64_t		 start = w->pos, lo, hi;
+
+	w->pos += sz;
+	if (w->pos <= w->first || start > w->last)
+		return 1;
+
+	lo = (w->first > start ? w->first : start) - start;
+	hi = (w->last + 1 < w->pos ? w->last + 1 : w->pos) - start;
+	timing.bytes += hi - lo;
+	return khttp_write(w->r, buf + lo, hi - lo) == KCGI_OK;
+}
+
+/*
+ * Write the part of a piece of a log within the "arg" window of lines
+ * (see log_read_window()) as HTML, each line being its own element
+ * with an anchor.
+ * Lines may span pieces, so the last may be left open.
+ */
+static int
+log_write_lines(const char *buf, size_t sz, void *arg)
+{
+	struct logwin	*w = arg;
+	const char	*cp = buf, *nl, *end = buf + sz;
+	char		 id[24], href[32];
+
+	while (cp < end && w->pos <= w->last) {
+		nl = memchr(cp, '\n', end - cp);
+		if (w->pos >= w->first) {
+			if (!w->open) {
+				snprintf(id, sizeof(id), 
+					"L%" PRId64, w->pos + 1);
+				snprintf(href, sizeof(href), "#%s", id);
+				khtml_attr(&w->html, KELEM_DIV,
+					KATTR_ID, id, KATTR_CLASS,
+					"report-log-line", KATTR__MAX);
+				khtml_attr(&w->html, KELEM_A,
+					KATTR_HREF, href, KATTR__MAX);
+				khtml_int(&w->html, w->pos + 1);
+				khtml_closeelem(&w->html, 1); /* a */
+				khtml_elem(&w->html, KELEM_SPAN);
+				w->open = 1;
+			}
+			if (khtml_write(cp, 
+			    (nl == NULL ? end : nl) - cp,
+			    &w->html) != KCGI_OK)
+				return 0;
+			if (nl != NULL) {
+				khtml_closeelem(&w->html, 2); /* span, div */
+				w->open = 0;
+			}
+		}
+		if (nl == NULL)
+			break;
+		w->pos++;
+		cp = nl + 1;
+	}
+
+	return 1;
+}
+
+/*
+ * Output bytes "first" through "last" of the log, or HTTP 416 if "ok"
+ * is zero (see http_range()).
+ * The range is of the log as is, so it's never compressed.
+ */
+static void
+get_single_range(struct kreq *r, const struct logblob *lb,
+	const struct tag *tag, int ok, int64_t first, int64_t last)
+{
+	struct logwin	 w;
+	struct logchunk	*c = NULL;
+
+	if (ok)
+		c = db_logchunk_get_atoffs(r->arg, 
+			lb->id, /* logblobid */
+			first); /* offs */
+
+	if (c == NULL) {
+		http_head(r, KHTTP_416, KMIME__MAX, NULL);
+		khttp_head(r, kresps[KRESP_CONTENT_RANGE], 
+			"bytes */%" PRId64, lb->size);
+		khttp_body(r);
+		return;
+	}
+
+	http_head(r, KHTTP_206, r->mime, tag);
+	khttp_head(r, kresps[KRESP_ACCEPT_RANGES], "bytes");
+	khttp_head(r, kresps[KRESP_CONTENT_RANGE], 
+		"bytes %" PRId64 "-%" PRId64 "/%" PRId64, 
+		first, last, lb->size);
+	khttp_head(r, kresps[KRESP_CONTENT_LENGTH], 
+		"%" PRId64, last - first + 1);
+	khttp_body_compress(r, 0);
+
+	memset(&w, 0, sizeof(struct logwin));
+	w.r = r;
+	w.first = first;
+	w.last = last;
+	w.pos = c->offs;
+	log_read_window(r, lb, c->seq, last, 0, log_write_range, &w);
+	db_logchunk_free(c);
+}
+
+/*
+ * Output only the log (which may be zero-length).
+ * If "raw", the log is sent as stored (see get_single()).
+ */
+static void
+get_single_text(struct kreq *r, const struct logblob *lb, int raw)
+{
+
+	log_read(r, lb, raw, log_write_http, r);
+}
+
+/*
+ * Find the resource usage of a stage in "mq", which may be NULL.
+ * Returns NULL if not found.
+ */
+static const struct stagemetrics *
+metrics_find(const struct stagemetrics_q *mq, enum stage stage)
+{
+	const struct stagemetrics	*m;
+
+	if (mq != NULL)
+		TAILQ_FOREACH(m, mq, _entries)
+			if (m->stage == stage)
+				return m;
+	return NULL;
+}
+
+/*
+ * List a single record as text/html.
+ */
+static void
+get_single_html(struct kreq *r, const struct report *p,
+	const struct reportdetail *d, const struct logblob *lb,
+	const struct stagemetrics_q *mq)
+{
+	struct khtmlreq	 req;
+	struct hbuf	 hb;
+	char		 buf[64];
+	char		 commitshort[8];
+	char		*url = NULL, *urlcommit, *urlproj, *urluname,
+			*urltrend, *urllog = NULL;
+
+	urlproj = url_index(r, 
+		VALID_PROJECT_NAME, p->project.name, 0);
+	urlcommit = arena_printf("%s/%s/tree/%s",
+		COMMIT_BASE, p->project.name,
+		p->revision.hash);
+	urluname = url_index(r, 
+		VALID_REPORT_MACHINEID, NULL, p->machineid);
+	urltrend = url_partx(r->pname,
+		ksuffixes[KMIME_TEXT_HTML],
+		pages[PAGE_TREND],
+		valid_keys[VALID_PROJECT_NAME].name,
+		KATTRX_STRING, p->project.name,
+		valid_keys[VALID_REPORT_MACHINEID].name,
+		KATTRX_INT, p->machineid, NULL);
+
+	khtml_open(&req, r, 0);
+	hbuf_open(&hb, r);
+	kcgi_writer_disable(r);
+	html_open(&hb, "Report");
+
+	/* Heading. */
+
+	khtml_elem(&req, KELEM_HEADER);
+	khtml_attr(&req, KELEM_H1,
+		KATTR_CLASS, "singleton", KATTR__MAX);
+	khtml_attr(&req, KELEM_A, 
+		KATTR_HREF, URL_DASH, KATTR__MAX);
+	khtml_puts(&req, "Dashboard");
+	khtml_closeelem(&req, 1); /* a */
+	khtml_ncr(&req, 0x203a);
+	khtml_elem(&req, KELEM_SPAN);
+	khtml_puts(&req, "Reports");
+	khtml_closeelem(&req, 1); /* span */
+	khtml_ncr(&req, 0x203a);
+	khtml_attr(&req, KELEM_SPAN,
+		KATTR_CLASS, "report-id", KATTR__MAX);
+	if (p->id < 1000)
+		khtml_int(&req, 0);
+	if (p->id < 100)
+		khtml_int(&req, 0);
+	if (p->id < 10)
+		khtml_int(&req, 0);
+	khtml_int(&req, p->id);
+	khtml_closeelem(&req, 1); /* span */
+	khtml_closeelem(&req, 1); /* h1 */
+	khtml_closeelem(&req, 1); /* header */
+
+	/* Body. */
+
+	khtml_attr(&req, KELEM_DIV,
+		KATTR_CLASS, "singleton", KATTR__MAX);
+	khtml_attr(&req, KELEM_SPAN, KATTR_CLASS, 
+		"lefthead report-id", KATTR__MAX);
+	if (p->id < 1000)
+		khtml_int(&req, 0);
+	if (p->id < 100)
+		khtml_int(&req, 0);
+	if (p->id < 10)
+		khtml_int(&req, 0);
+	khtml_int(&req, p->id);
+	khtml_closeelem(&req, 1); /* div */
+
+	khtml_attr(&req, KELEM_SPAN, KATTR_CLASS, 
+		"lefthead project-name", KATTR__MAX);
+	khtml_attr(&req, KELEM_A, KATTR_HREF, urlproj, KATTR__MAX);
+	khtml_puts(&req, p->project.name);
+	khtml_closeelem(&req, 1); /* a */
+	khtml_closeelem(&req, 1); /* span */
+
+	khtml_attr(&req, KELEM_SPAN, KATTR_CLASS, 
+		"lefthead project-repo", KATTR__MAX);
+	khtml_attr(&req, KELEM_A, KATTR_CLASS, 
+		"lefthead report-commit", 
+		KATTR_HREF, urlcommit, KATTR__MAX);
+	strlcpy(commitshort, p->revision.hash, sizeof(commitshort));
+	khtml_puts(&req, commitshort);
+	khtml_closeelem(&req, 1); /* a */
+	khtml_closeelem(&req, 1); /* span */
+
+	khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
+		"lefthead report-start", KATTR__MAX);
+	khtml_attrx(&req, KELEM_TIME,
+		KATTR_DATETIME, KATTRX_INT, 
+		p->start, KATTR__MAX);
+	kutil_epoch2str(p->start, buf, sizeof(buf));
+	khtml_puts(&req, buf);
+	khtml_closeelem(&req, 1); /* time */
+	khtml_closeelem(&req, 1); /* div */
+
+	khtml_attr(&req, KELEM_DIV, KATTR_CLASS,
+		"lefthead report-system", KATTR__MAX);
+	khtml_attr(&req, KELEM_A, 
+		KATTR_HREF, urluname, KATTR__MAX);
+	get_html_uname(&req, p);
+	khtml_closeelem(&req, 1); /* a */
+	khtml_closeelem(&req, 1); /* div */
+
+	khtml_attr(&req, KELEM_DIV, KATTR_CLASS,
+		"lefthead report-system-ext", KATTR__MAX);
+	khtml_puts(&req, d->unamev);
+	khtml_closeelem(&req, 1); /* div */
+
+	khtml_attr(&req, KELEM_A, 
+		KATTR_CLASS, "report-trend-link", 
+		KATTR_HREF, urltrend, KATTR__MAX);
+	khtml_closeelem(&req, 1); /* a */
+
+	khtml_attr(&req, KELEM_DIV,
+		KATTR_CLASS, "leftgroup", KATTR__MAX);
+	get_html_offs(&req, "lefthead "
+		"report-env", p->start, p->env,
+		metrics_find(mq, STAGE_env));
+	get_html_offs(&req, "lefthead "
+		"report-deps", p->env, p->depend,
+		metrics_find(mq, STAGE_depend));
+	get_html_offs(&req, "lefthead "
+		"report-build", p->depend, p->build,
+		metrics_find(mq, STAGE_build));
+	get_html_offs(&req, "lefthead "
+		"report-regress", p->build, p->test,
+		metrics_find(mq, STAGE_test));
+	get_html_offs(&req, "lefthead "
+		"report-install", p->test, p->install,
+		metrics_find(mq, STAGE_install));
+	get_html_offs(&req, "lefthead "
+		"report-dist", p->install, p->distcheck,
+		metrics_find(mq, STAGE_distcheck));
+	khtml_closeelem(&req, 1); /* div */
+
+	if (p->distcheck == 0)
+		khtml_attr(&req, KELEM_DIV, KATTR_CLASS,
+			"report-failure", KATTR__MAX);
+	else
+		khtml_attr(&req, KELEM_DIV, KATTR_CLASS,
+			"report-success", KATTR__MAX);
+	khtml_closeelem(&req, 1); /* div */
+
+	/* Emit the log tail only if it's non-empty. */
+
+	if (lb->size > 0) {
+		khtml_attr(&req, KELEM_DIV, KATTR_CLASS,
+			"report-log-box", KATTR__MAX);
+		khtml_attr(&req, KELEM_DIV, KATTR_CLASS,
+			"report-log", KATTR__MAX);
+		khtml_puts(&req, lb->tail);
+		khtml_closeelem(&req, 1); /* div */
+		url = url_partx(r->pname, 
+			ksuffixes[KMIME_TEXT_PLAIN],
+			pages[PAGE_INDEX],
+			valid_keys[VALID_REPORT_ID].name,
+			KATTRX_INT, p->id, NULL);
+		khtml_attr(&req, KELEM_A, 
+			KATTR_CLASS, "report-log-link", 
+			KATTR_HREF, url, KATTR__MAX);
+		khtml_attr(&req, KELEM_SPAN,
+			KATTR_CLASS, "report-log-lines", KATTR__MAX);
+		khtml_int(&req, lb->lines);
+		khtml_closeelem(&req, 1); /* span */
+		khtml_closeelem(&req, 1); /* a */
+		urllog = url_partx(r->pname, 
+			ksuffixes[KMIME_TEXT_HTML],
+			pages[PAGE_LOG],
+			valid_keys[VALID_REPORT_ID].name,
+			KATTRX_INT, p->id, 
+			"from", KATTRX_INT, lb->lines > LOGPAGE ?
+			lb->lines - LOGPAGE + 1 : 1, NULL);
+		khtml_attr(&req, KELEM_A, 
+			KATTR_CLASS, "report-log-browse", 
+			KATTR_HREF, urllog, KATTR__MAX);
+		khtml_closeelem(&req, 1); /* a */
+		khtml_closeelem(&req, 1); /* div */
+	}
+
+	khtml_closeelem(&req, 1); /* div */
+	khtml_close(&req);
+	html_close(&hb);
+}
+
+/*
+ * Print a single record as JSON.
+ * The log is put with the details, as it was before being stored
+ * separately, unless "lb" is NULL.
+ */
+static void
+get_single_json(struct kreq *r, const struct report *p,
+	const struct reportdetail *d, const struct logblob *lb,
+	const struct stagemetrics_q *mq)
+{
+	struct kjsonreq	 req;
+
+	kjson_open(&req, r);
+	kcgi_writer_disable(r);
+	kjson_obj_open(&req);
+	json_report_obj(p, &req);
+	kjson_objp_open(&req, "reportdetail");
+	kjson_putintp(&req, "reportid", d->reportid);
+	if (lb != NULL) {
+		kjson_stringp_open(&req, "log");
+		log_read(r, lb, 0, log_write_json, &req);
+		kjson_string_close(&req);
+	}
+	kjson_putstringp(&req, "unamev", d->unamev);
+	kjson_putintp(&req, "id", d->id);
+	kjson_obj_close(&req);
+	json_stagemetrics_array(mq, &req);
+	kjson_obj_close(&req);
+	kjson_close(&req);
+}
+
+/*
+ * Routes a record to its MIME type output.
+ * Outputs HTTP 404 (error) or 200 (success).
+ */
+static void
+get_single(struct kreq *r)
+{
+	struct report		*p;
+	struct reportdetail	*d = NULL;
+	struct logblob		*lb = NULL;
+	struct stagemetrics_q	*mq = NULL;
+	struct kpair		*kp;
+	struct tag		 tag;
+	int64_t			 first, last;
+	int			 rc, raw;
+
+	kp = r->fieldmap[VALID_REPORT_ID];
+	assert(kp != NULL);
+
+	p = db_report_get_byid(r->arg, 
+		kp->parsed.i); /* id */
+
+	if (p == NULL) {
+		http_open(r, KHTTP_404, KMIME__MAX, NULL);
+		return;
+	}
+
+	/* Reports never change once inserted. */
+
+	tag.id = p->id;
+	tag.mtime = p->ctime;
+	tag.day = 0;
+	if (http_fresh(r, &tag)) {
+		db_report_free(p);
+		return;
+	}
+
+	d = db_reportdetail_get_byreport(r->arg, 
+		p->id); /* reportid */
+
+	if (d == NULL) {
+		http_open(r, KHTTP_404, KMIME__MAX, NULL);
+		db_report_free(p);
+		return;
+	}
+
+	/* 
+	 * The log is left out of JSON if the non-ORT "log" field is
+	 * zero, as it may be large.
+	 */
+
+	if (r->mime != KMIME_APP_JSON ||
+	    (kp = field_get(r, "log", kvalid_int)) == NULL ||
+	    kp->parsed.i != 0) {
+		lb = db_logblob_get_bydigest(r->arg,
+			p->logdigest); /* digest */
+		if (lb == NULL) {
+			http_open(r, KHTTP_404, KMIME__MAX, NULL);
+			db_reportdetail_free(d);
+			db_report_free(p);
+			return;
+		}
+	}
+
+	/* The log doesn't need resource usage. */
+
+	if (r->mime != KMIME_TEXT_PLAIN)
+		mq = db_stagemetrics_list_byreport(r->arg, 
+			p->id); /* reportid */
+
+	/* 
+	 * Emit either our log (or a range of it) or the full record.
+	 * A compressed log is sent as stored to clients accepting it,
+	 * which is why kcgi mustn't compress it again.
+	 */
+
+	timing.rows++;
+	if (r->mime == KMIME_TEXT_PLAIN && (rc = http_range(r, 
+	    &tag, lb->size, &first, &last)) != -1) {
+		get_single_range(r, lb, &tag, rc, first, last);
+	} else if (r->mime == KMIME_TEXT_PLAIN) {
+		raw = lb->enc == LOGENC_gzip && http_gzip(r);
+		http_head(r, KHTTP_200, r->mime, &tag);
+		khttp_head(r, kresps[KRESP_ACCEPT_RANGES], "bytes");
+		if (raw) {
+			khttp_head(r, kresps[KRESP_CONTENT_ENCODING], 
+				"gzip");
+			khttp_body_compress(r, 0);
+		} else
+			khttp_body(r);
+		get_single_text(r, lb, raw);
+	} else {
+		http_open(r, KHTTP_200, r->mime, &tag);
+		if (r->mime == KMIME_APP_JSON)
+			get_single_json(r, p, d, lb, mq);
+		else
+			get_single_html(r, p, d, lb, mq);
+	}
+
+	if (mq != NULL)
+		db_stagemetrics_freeq(mq);
+	db_logblob_free(lb);
+	db_reportdetail_free(d);
+	db_report_free(p);
+}
+
+/*
+ * Print a link to the page of the log viewer (see get_log()) of report
+ * "id" starting at line "from".
+ */
+static void
+get_log_page(struct kreq *r, struct khtmlreq *req, int64_t id,
+	int64_t from, int64_t count, const char *text)
+{
+	char	*url;
+
+	url = url_partx(r->pname, 
+		ksuffixes[KMIME_TEXT_HTML],
+		pages[PAGE_LOG],
+		valid_keys[VALID_REPORT_ID].name, KATTRX_INT, id,
+		"from", KATTRX_INT, from,
+		"count", KATTRX_INT, count, NULL);
+	khtml_attr(req, KELEM_A, KATTR_CLASS, 
+		"page-link", KATTR_HREF, url, KATTR__MAX);
+	khtml_puts(req, text);
+	khtml_closeelem(req, 1); /* a */
+}
+
+/*
+ * Page through the log of a report by line.
+ * Pages start at the non-ORT "from" field, else the first line, and
+ * are the non-ORT "count" field long, else LOGPAGE.
+ * Only the chunks of the log holding the page are read.
+ * Outputs HTTP 404 (error) or 200 (success).
+ */
+static void
+get_log(struct kreq *r)
+{
+	struct khtmlreq		*req;
+	struct hbuf		 hb;
+	struct report		*p = NULL;
+	struct logblob		*lb = NULL;
+	struct logchunk		*c;
+	struct kpair		*kp;
+	struct logwin		 w;
+	struct tag		 tag;
+	int64_t			 from = 1, count = LOGPAGE, seq = 0;
+	char			*url;
+
+	if (r->mime != KMIME_TEXT_HTML ||
+	    (kp = r->fieldmap[VALID_REPORT_ID]) == NULL ||
+	    (p = db_report_get_byid(r->arg, 
+	     kp->parsed.i)) == NULL) { /* id */
+		http_open(r, KHTTP_404, KMIME__MAX, NULL);
+		return;
+	}
+
+	if ((kp = field_get(r, "from", kvalid_uint)) != NULL &&
+	    kp->parsed.i > 0)
+		from = kp->parsed.i;
+	if ((kp = field_get(r, "count", kvalid_uint)) != NULL &&
+	    kp->parsed.i > 0)
+		count = kp->parsed.i > LOGPAGEMAX ?
+			LOGPAGEMAX : kp->parsed.i;
+
+	/* Reports never change once inserted. */
+
+	tag.id = p->id;
+	tag.mtime = p->ctime;
+	tag.day = 0;
+	if (http_fresh(r, &tag)) {
+		db_report_free(p);
+		return;
+	}
+
+	lb = db_logblob_get_bydigest(r->arg,
+		p->logdigest); /* digest */
+	if (lb == NULL || (from > lb->lines && from > 1)) {
+		http_open(r, KHTTP_404, KMIME__MAX, NULL);
+		db_logblob_free(lb);
+		db_report_free(p);
+		return;
+	}
+
+	/* Lines are from one in the page, from zero in the index. */
+
+	memset(&w, 0, sizeof(struct logwin));
+	w.r = r;
+	w.first = from - 1;
+	w.last = from - 1 + count - 1;
+	c = db_logchunk_get_beforeline(r->arg,
+		lb->id, /* logblobid */
+		w.first); /* line */
+	if (c != NULL) {
+		seq = c->seq;
+		w.pos = c->line;
+		db_logchunk_free(c);
+	}
+
+	url = url_partx(r->pname, 
+		ksuffixes[KMIME_TEXT_HTML],
+		pages[PAGE_INDEX],
+		valid_keys[VALID_REPORT_ID].name,
+		KATTRX_INT, p->id, NULL);
+
+	http_open(r, KHTTP_200, r->mime, &tag);
+	req = &w.html;
+	khtml_open(req, r, 0);
+	hbuf_open(&hb, r);
+	kcgi_writer_disable(r);
+	html_open(&hb, "Log");
+
+	khtml_elem(req, KELEM_HEADER);
+	khtml_attr(req, KELEM_H1,
+		KATTR_CLASS, "singleton", KATTR__MAX);
+	khtml_attr(req, KELEM_A, 
+		KATTR_HREF, "index.html", KATTR__MAX);
+	khtml_puts(req, "Dashboard");
+	khtml_closeelem(req, 1); /* a */
+	khtml_ncr(req, 0x203a);
+	khtml_attr(req, KELEM_A, KATTR_CLASS,
+		"report-id", KATTR_HREF, url, KATTR__MAX);
+	if (p->id < 1000)
+		khtml_int(req, 0);
+	if (p->id < 100)
+		khtml_int(req, 0);
+	if (p->id < 10)
+		khtml_int(req, 0);
+	khtml_int(req, p->id);
+	khtml_closeelem(req, 1); /* a */
+	khtml_ncr(req, 0x203a);
+	khtml_elem(req, KELEM_SPAN);
+	khtml_puts(req, "Log");
+	khtml_closeelem(req, 1); /* span */
+	khtml_closeelem(req, 1); /* h1 */
+	khtml_closeelem(req, 1); /* header */
+
+	khtml_attr(req, KELEM_DIV, KATTR_CLASS, 
+		"singleton report-log report-log-view", KATTR__MAX);
+	log_read_window(r, lb, seq, w.last, 1, log_write_lines, &w);
+	if (w.open)
+		khtml_closeelem(req, 2); /* span, div */
+	khtml_closeelem(req, 1); /* div */
+
+	if (from > 1 || from - 1 + count < lb->lines) {
+		khtml_attr(req, KELEM_NAV,
+			KATTR_CLASS, "pages", KATTR__MAX);
+		if (from > 1)
+			get_log_page(r, req, p->id, from > count ?
+				from - count : 1, count, "Earlier");
+		if (from - 1 + count < lb->lines)
+			get_log_page(r, req, p->id, 
+				from + count, count, "Later");
+		khtml_closeelem(req, 1); /* nav */
+	}
+
+	khtml_close(req);
+	html_close(&hb);
+	db_logblob_free(lb);
+	db_report_free(p);
+}
+
+/*
+ * List the summary of each project as maintained by post().
+ * Always outputs HTTP 200.
+ */
+static void
+get_dash(struct kreq *r, const struct tag *tag)
+{
+	struct khtmlreq		 req;
+	struct hbuf		 hb;
+	struct projsummary_q	*sq;
+	struct projsummary	*s;
+	int64_t			 maxdone = 0;
+	struct tm		 tm;
+	char			*urlproj, *urlcommit, *urltrend;
+	char			 datebuf[32], commitshort[8];
+
+	/* Open output page. */
+
+	http_open(r, KHTTP_200, r->mime, tag);
+	khtml_open(&req, r, 0);
+	hbuf_open(&hb, r);
+	kcgi_writer_disable(r);
+	html_open(&hb, "Reports");
+
+	/* Output header. */
+
+	khtml_elem(&req, KELEM_HEADER);
+	khtml_attr(&req, KELEM_H1, 
+		KATTR_CLASS, "table", KATTR__MAX);
+
+	khtml_elem(&req, KELEM_SPAN);
+	khtml_puts(&req, "Dashboard");
+	khtml_closeelem(&req, 1); /* span */
+	khtml_ncr(&req, 0x203a);
+	khtml_elem(&req, KELEM_SPAN);
+	khtml_puts(&req, "All Projects");
+	khtml_closeelem(&req, 1); /* span */
+	khtml_closeelem(&req, 1); /* h1 */
+	khtml_closeelem(&req, 1); /* header */
+
+	/* Output data. */
+
+	khtml_attr(&req, KELEM_DIV, 
+		KATTR_CLASS, "table alltable", KATTR__MAX);
+
+	timing_phase(PHASE_SQL);
+	sq = db_projsummary_list_dash(r->arg);
+	timing_phase(PHASE_RENDER);
+
+	/* Scale completion by the most-completed project. */
+
+	TAILQ_FOREACH(s, sq, _entries)
+		if (s->finished > maxdone)
+			maxdone = s->finished;
+
+	/* Header row. */
+
+	HBUF_BLOB(&hb, 
+		"<div class=\"row\">"
+		"<div class=\"head report-successrate\"></div>"
+		"<div class=\"head project-name\"></div>"
+		"<div class=\"head report-finished-pct\"></div>"
+		"<div class=\"head report-pending\"></div>"
+		"<div class=\"head report-newest\"></div>"
+		"<div class=\"head report-commit\"></div>"
+		"</div>");
+
+	/* 
+	 * Now each project's data, assembled with the others and
+	 * written once there's enough.
+	 */
+
+	TAILQ_FOREACH(s, sq, _entries) {
+		urlproj = url_index(r, 
+			VALID_PROJECT_NAME, s->project.name, 0);
+		urltrend = url_partx(r->pname, 
+			ksuffixes[KMIME_TEXT_HTML],
+			pages[PAGE_TREND],
+			valid_keys[VALID_PROJECT_NAME].name,
+			KATTRX_STRING, s->project.name, NULL);
+		urlcommit = arena_printf("%s/%s/tree/%s",
+			COMMIT_BASE, s->project.name, 
+			s->nrevision.hash);
+
+		assert(s->finished + s->pending > 0);
+		timing.rows++;
+
+		kcgi_buf_printf(&hb.b, 
+			"<div class=\"row\">"
+			"<div class=\"cell report-successrate\">"
+			"<span class=\"%s\">%.0f</span></div>",
+			s->success == s->finished ?
+			"report-pass" : "report-fail",
+			s->finished == 0 ? 0 : floor
+			(100 * s->success / s->finished));
+
+		HBUF_BLOB(&hb, 
+			"<div class=\"cell project-name\"><a href=\"");
+		hbuf_puts(&hb, urlproj);
+		HBUF_BLOB(&hb, "\">");
+		hbuf_puts(&hb, s->project.name);
+		HBUF_BLOB(&hb, "</a>");
+		if (s->regressed > 0) {
+			HBUF_BLOB(&hb, "<a class=\"report-regressed\" "
+				"href=\"");
+			hbuf_puts(&hb, urltrend);
+			HBUF_BLOB(&hb, "\">&#x2191;</a>");
+		}
+		HBUF_BLOB(&hb, "</div>");
+
+		gmtime_r(&s->nctime, &tm);
+		strftime(datebuf, sizeof(datebuf), "%F %T", &tm);
+		kcgi_buf_printf(&hb.b, 
+			"<div class=\"cell report-finished-pct\">%.0f</div>"
+			"<div class=\"cell report-pending\">%" PRId64 "</div>"
+			"<div class=\"cell report-newest\">%s</div>",
+			maxdone == 0 ? 0 : floor
+			(100 * s->finished / maxdone),
+			s->finished, datebuf);
+
+		HBUF_BLOB(&hb, 
+			"<div class=\"cell report-commit\"><a href=\"");
+		hbuf_puts(&hb, urlcommit);
+		HBUF_BLOB(&hb, "\">");
+		strlcpy(commitshort, s->nrevision.hash, 
+			sizeof(commitshort));
+		hbuf_puts(&hb, commitshort);
+		HBUF_BLOB(&hb, "</a></div>");
+
+		HBUF_BLOB(&hb, "</div>"); /* row */
+		if (hb.b.sz >= HBUFSZ)
+			hbuf_flush(&hb);
+
+	}
+
+	hbuf_flush(&hb);
+	khtml_closeelem(&req, 1); /* table */
+	khtml_close(&req);
+	html_close(&hb);
+
+	db_projsummary_freeq(sq);
+}
+
+/*
+ * Get the cursor from the non-ORT field "key", which is the identifier
+ * of a report.
+ * Returns zero if not found or malformed, non-zero on success.
+ */
+static int
+cursor_get(struct kreq *r, const char *key, int64_t *c)
+{
+	struct kpair	*kp;
+
+	if ((kp = field_get(r, key, kvalid_int)) == NULL)
+		return 0;
+	*c = kp->parsed.i;
+	return 1;
+}
+
+/*
+ * Print a project summary of the dashboard as JSON (see
+ * get_dash_json()), timed as rendering.
+ */
+static void
+get_json_dash_row(const struct projsummary *s, void *arg)
+{
+
+	timing_phase(PHASE_RENDER);
+	timing.rows++;
+	json_projsummary_iterate(s, arg);
+	timing_phase(PHASE_SQL);
+}
+
+/*
+ * Print the dashboard as JSON, each project summary written as it's
+ * read.
+ * Always outputs HTTP 200.
+ */
+static void
+get_dash_json(struct kreq *r, const struct tag *tag)
+{
+	struct kjsonreq	 req;
+
+	http_open(r, KHTTP_200, r->mime, tag);
+	kjson_open(&req, r);
+	kcgi_writer_disable(r);
+	kjson_obj_open(&req);
+	kjson_arrayp_open(&req, "projsummary");
+	timing_phase(PHASE_SQL);
+	db_projsummary_iterate_dash(r->arg, get_json_dash_row, &req);
+	timing_phase(PHASE_RENDER);
+	kjson_array_close(&req);
+	kjson_obj_close(&req);
+	kjson_close(&req);
+}
+
+/*
+ * Print a link to another page of the listing, starting at the cursor
+ * "c" in the direction of "dir" (the non-ORT field "before" or
+ * "after").
+ */
+static void
+get_html_page(struct req *req,
+	const char *dir, int64_t c, const char *text)
+{
+	char	*url, cur[32], n[32];
+
+	snprintf(cur, sizeof(cur), "%" PRId64, c);
+	snprintf(n, sizeof(n), "%zu", req->max);
+	url = url_partx(req->r->pname, 
+		ksuffixes[KMIME_TEXT_HTML],
+		pages[PAGE_INDEX],
+		valid_keys[req->key].name, KATTRX_STRING, 
+		req->r->fieldmap[req->key]->val,
+		dir, KATTRX_STRING, cur,
+		"n", KATTRX_STRING, n, NULL);
+	khtml_attr(&req->html, KELEM_A, KATTR_CLASS, 
+		"page-link", KATTR_HREF, url, KATTR__MAX);
+	khtml_puts(&req->html, text);
+	khtml_closeelem(&req->html, 1); /* a */
+}
+
+/*
+ * Set up paging of the newest records of a project or machine, or those
+ * of a given day, sorted by identifier.  This is the order in which
+ * they're inserted, which for spooled submissions may not be that of
+ * their ctime (when they were accepted).
+ * Pages start at the cursor of the non-ORT "before" field, or if not
+ * given, end at that of the "after" field; else they start with the
+ * newest.
+ * The page size is the non-ORT "n" field, else PAGESZ.
+ */
+static void
+page_init(struct kreq *r, struct req *req)
+{
+	struct kpair	*kp;
+
+	memset(req, 0, sizeof(struct req));
+	req->r = r;
+
+	if (r->fieldmap[VALID_PROJECT_NAME] != NULL)
+		req->key = VALID_PROJECT_NAME;
+	else if (r->fieldmap[VALID_REPORT_MACHINEID] != NULL)
+		req->key = VALID_REPORT_MACHINEID;
+	else
+		req->key = VALID_REPORT_CTIME;
+
+	assert(r->fieldmap[req->key] != NULL);
+
+	req->max = PAGESZ;
+	if ((kp = field_get(r, "n", kvalid_uint)) != NULL &&
+	    kp->parsed.i > 0 && kp->parsed.i <= PAGEMAX)
+		req->max = kp->parsed.i;
+
+	req->hasbefore = cursor_get(r, "before", &req->before);
+	req->hasafter = !req->hasbefore && 
+		cursor_get(r, "after", &req->after);
+	if (!req->hasbefore)
+		req->before = INT64_MAX;
+}
+
+/*
+ * Pass a row of page_query() to the listing's callback, timed as
+ * rendering.
+ */
+static void
+page_query_row(const struct report *p, void *arg)
+{
+	struct req	*req = arg;
+
+	timing_phase(PHASE_RENDER);
+	req->cb(p, req);
+	timing_phase(PHASE_SQL);
+}
+
+/*
+ * Pass each row of the page set up by page_init(), newest first, to
+ * "cb" with "req" as its argument.
+ */
+static void
+page_query(struct req *req, void (*cb)(const struct report *, void *))
+{
+	struct report_q	*rq = NULL;
+	struct report	*p, *np;
+	struct kpair	*kp;
+	size_t		 n;
+
+	kp = req->r->fieldmap[req->key];
+	req->cb = cb;
+	timing_phase(PHASE_SQL);
+
+	if (!req->hasafter && req->key == VALID_PROJECT_NAME)
+		db_report_iterate_dashname(req->r->arg, 
+			page_query_row, req,
+			kp->parsed.s, /* project.name */
+			req->before); /* id lt */
+	else if (!req->hasafter && req->key == VALID_REPORT_MACHINEID)
+		db_report_iterate_dashuname(req->r->arg, 
+			page_query_row, req,
+			kp->parsed.i, /* report.machineid */
+			req->before); /* id lt */
+	else if (!req->hasafter)
+		db_report_iterate_lastdate(req->r->arg, 
+			page_query_row, req,
+			kp->parsed.i, /* ctime ge */
+			kp->parsed.i + 86400, /* ctime le */
+			req->before); /* id lt */
+	else if (req->key == VALID_PROJECT_NAME)
+		rq = db_report_list_dashnameprev(req->r->arg,
+			kp->parsed.s, /* project.name */
+			req->after); /* id gt */
+	else if (req->key == VALID_REPORT_MACHINEID)
+		rq = db_report_list_dashunameprev(req->r->arg,
+			kp->parsed.i, /* report.machineid */
+			req->after); /* id gt */
+	else
+		rq = db_report_list_lastdateprev(req->r->arg,
+			kp->parsed.i, /* ctime ge */
+			kp->parsed.i + 86400, /* ctime le */
+			req->after); /* id gt */
+
+	timing_phase(PHASE_RENDER);
+	if (rq == NULL)
+		return;
+
+	/* 
+	 * Newer pages are oldest first, so find the last row of the
+	 * page and go backward from there.
+	 */
+
+	n = 0;
+	np = NULL;
+	TAILQ_FOREACH(p, rq, _entries) {
+		if (n++ == req->max) {
+			req->more = 1;
+			break;
+		}
+		np = p;
+	}
+	for (p = np; p != NULL; p = TAILQ_PREV(p, report_q, _entries))
+		cb(p, req);
+
+	db_report_freeq(rq);
+}
+
+/*
+ * Whether the page queried by page_query() has newer or older pages.
+ * If going backward (after), "more" means newer pages; else, it means
+ * older pages.
+ */
+#define	PAGE_NEWER(_r) \
+	((_r)->count > 0 && ((_r)->hasbefore || ((_r)->hasafter && (_r)->more)))
+#define	PAGE_OLDER(_r) \
+	((_r)->count > 0 && ((_r)->hasafter || (_r)->more))
+
+/*
+ * List a page of records as set up by page_init().
+ * Always outputs HTTP 200.
+ */
+static void
+get_last(struct kreq *r, const struct tag *tag)
+{
+	struct req		 req;
+	struct kpair		*kpn, *kpd, *kph;
+	struct projsummary	*sum = NULL;
+	time_t			 t;
+	struct tm		 tm;
+	char			 datebuf[32];
+	char			*urltrend = NULL;
+
+	page_init(r, &req);
+
+	kpn = r->fieldmap[VALID_PROJECT_NAME];
+	kpd = r->fieldmap[VALID_REPORT_CTIME];
+	kph = r->fieldmap[VALID_REPORT_MACHINEID];
+
+	/* Open output page. */
+
+	http_open(r, KHTTP_200, r->mime, tag);
+	khtml_open(&req.html, r, 0);
+	hbuf_open(&req.hb, r);
+	kcgi_writer_disable(r);
+	html_open(&req.hb, "Reports");
+
+	/* Output header. */
+
+	khtml_elem(&req.html, KELEM_HEADER);
+	khtml_attr(&req.html, KELEM_H1, 
+		KATTR_CLASS, "table", KATTR__MAX);
+
+	if (kpn != NULL) {
+		khtml_attr(&req.html, KELEM_A,
+			KATTR_HREF, URL_DASH, KATTR__MAX);
+		khtml_puts(&req.html, "Dashboard");
+		khtml_closeelem(&req.html, 1); /* a */
+		khtml_ncr(&req.html, 0x203a);
+		khtml_elem(&req.html, KELEM_SPAN);
+		khtml_puts(&req.html, kpn->parsed.s);
+		khtml_closeelem(&req.html, 1); /* span */
+		khtml_ncr(&req.html, 0x203a);
+		urltrend = url_partx(r->pname, 
+			ksuffixes[KMIME_TEXT_HTML],
+			pages[PAGE_TREND],
+			valid_keys[VALID_PROJECT_NAME].name,
+			KATTRX_STRING, kpn->parsed.s, NULL);
+		khtml_attr(&req.html, KELEM_A,
+			KATTR_HREF, urltrend, KATTR__MAX);
+		khtml_puts(&req.html, "Trend");
+		khtml_closeelem(&req.html, 1); /* a */
+		khtml_closeelem(&req.html, 1); /* h1 */
+		sum = db_projsummary_get_byprojname(r->arg, 
+			kpn->parsed.s); /* project.name */
+		if (sum != NULL && sum->nrevision.hash[0] != '\0')
+			req.nrevision = sum->nrevisionid;
+	} else if (kph != NULL) {
+		khtml_attr(&req.html, KELEM_A,
+			KATTR_HREF, URL_DASH, KATTR__MAX);
+		khtml_puts(&req.html, "Dashboard");
+		khtml_closeelem(&req.html, 1); /* a */
+		khtml_ncr(&req.html, 0x203a);
+		khtml_elem(&req.html, KELEM_SPAN);
+		khtml_puts(&req.html, "Machine Dashboard");
+		khtml_closeelem(&req.html, 1); /* span */
+		khtml_closeelem(&req.html, 1); /* h1 */
+	} else {
+		khtml_attr(&req.html, KELEM_A,
+			KATTR_HREF, URL_DASH, KATTR__MAX);
+		khtml_puts(&req.html, "Dashboard");
+		khtml_closeelem(&req.html, 1); /* a */
+		khtml_ncr(&req.html, 0x203a);
+		khtml_elem(&req.html, KELEM_SPAN);
+		t = kpd->parsed.i;
+		gmtime_r(&t, &tm);
+		strftime(datebuf, sizeof(datebuf), "%F", &tm);
+		khtml_puts(&req.html, datebuf);
+		khtml_closeelem(&req.html, 1); /* span */
+		khtml_closeelem(&req.html, 1); /* h1 */
+	}
+
+	khtml_closeelem(&req.html, 1); /* h1 */
+	khtml_closeelem(&req.html, 1); /* header */
+
+	/* Output data. */
+
+	if (kpn != NULL)
+		khtml_attr(&req.html, KELEM_DIV, 
+			KATTR_CLASS, "table projtable", KATTR__MAX);
+	else if (kph != NULL)
+		khtml_attr(&req.html, KELEM_DIV, 
+			KATTR_CLASS, "table unametable", KATTR__MAX);
+	else
+		khtml_attr(&req.html, KELEM_DIV, 
+			KATTR_CLASS, "table datetable", KATTR__MAX);
+	get_html_last_header(&req.hb);
+	page_query(&req, get_html_last_report);
+	hbuf_flush(&req.hb);
+	khtml_closeelem(&req.html, 1); /* table */
+
+	if (PAGE_NEWER(&req) || PAGE_OLDER(&req)) {
+		khtml_attr(&req.html, KELEM_NAV,
+			KATTR_CLASS, "pages", KATTR__MAX);
+		if (PAGE_NEWER(&req))
+			get_html_page(&req, 
+				"after", req.first, "Newer");
+		if (PAGE_OLDER(&req))
+			get_html_page(&req, 
+				"before", req.last, "Older");
+		khtml_closeelem(&req.html, 1); /* nav */
+	}
+
+	khtml_close(&req.html);
+	html_close(&req.hb);
+	db_projsummary_free(sum);
+}
+
+/*
+ * Print a record of a listing as an object of a JSON array.
+ */
+static void
+get_json_last_report(const struct report *p, void *arg)
+{
+	struct req	*r = arg;
+
+	if (page_row(r, p))
+		json_report_iterate(p, &r->json);
+}
+
+/*
+ * List a page of records as set up by page_init() as JSON.
+ * Rows are written as they're read.
+ * The cursors of the newer and older pages, if any, are given as the
+ * "newer" and "older" strings.
+ * Always outputs HTTP 200.
+ */
+static void
+get_last_json(struct kreq *r, const struct tag *tag)
+{
+	struct req	 req;
+	char		 cur[32];
+
+	page_init(r, &req);
+	http_open(r, KHTTP_200, r->mime, tag);
+	kjson_open(&req.json, r);
+	kcgi_writer_disable(r);
+	kjson_obj_open(&req.json);
+	kjson_arrayp_open(&req.json, "report");
+	page_query(&req, get_json_last_report);
+	kjson_array_close(&req.json);
+	if (PAGE_NEWER(&req)) {
+		snprintf(cur, sizeof(cur), "%" PRId64, req.first);
+		kjson_putstringp(&req.json, "newer", cur);
+	}
+	if (PAGE_OLDER(&req)) {
+		snprintf(cur, sizeof(cur), "%" PRId64, req.last);
+		kjson_putstringp(&req.json, "older", cur);
+	}
+	kjson_obj_close(&req.json);
+	kjson_close(&req.json);
+}
+
+/*
+ * Print a day of a trend: the mean duration of each stage, indexed by
+ * stage, over the "count" reports completing it with "total"
+ * durations, of which "regressed" were flagged.
+ */
+static void
+get_html_trend_row(struct khtmlreq *req, time_t day, 
+	const int64_t *count, const int64_t *total, 
+	const int64_t *regressed)
+{
+	static const char *const classes[STAGESZ] = {
+		"cell report-env", /* STAGE_env */
+		"cell report-deps", /* STAGE_depend */
+		"cell report-build", /* STAGE_build */
+		"cell report-regress", /* STAGE_test */
+		"cell report-install", /* STAGE_install */
+		"cell report-dist", /* STAGE_distcheck */
+	};
+	struct tm	 tm;
+	char		 buf[32];
+	size_t		 i;
+
+	khtml_attr(req, KELEM_DIV, KATTR_CLASS, "row", KATTR__MAX);
+	khtml_attr(req, KELEM_DIV, KATTR_CLASS, 
+		"cell report-start", KATTR__MAX);
+	gmtime_r(&day, &tm);
+	strftime(buf, sizeof(buf), "%F", &tm);
+	khtml_puts(req, buf);
+	khtml_closeelem(req, 1); /* cell */
+
+	khtml_attr(req, KELEM_DIV, 
+		KATTR_CLASS, "cellgroup", KATTR__MAX);
+	for (i = 0; i < STAGESZ; i++) {
+		khtml_attr(req, KELEM_DIV, 
+			KATTR_CLASS, classes[i], KATTR__MAX);
+		if (count[i] > 0) {
+			khtml_attr(req, KELEM_TIME, KATTR_CLASS, 
+				regressed[i] > 0 ? 
+				"report-regressed" : "success", 
+				KATTR__MAX);
+			khtml_int(req, total[i] / count[i]);
+			khtml_closeelem(req, 1); /* time */
+		}
+		khtml_closeelem(req, 1); /* cell */
+	}
+	khtml_closeelem(req, 1); /* cellgroup */
+	khtml_closeelem(req, 1); /* row */
+}
+
+/*
+ * Print the trend of the rollup of a project or, if "p" is not NULL,
+ * that of p's machine for the project.
+ * Rows of the same day (i.e., of different machines for a project) are
+ * summed together.
+ */
+static void
+get_trend_html(struct kreq *r, const struct rollup_q *rq,
+	const char *name, const struct report *p)
+{
+	struct khtmlreq		 req;
+	struct hbuf		 hb;
+	const struct rollup	*ru;
+	int64_t			 count[STAGESZ], total[STAGESZ],
+				 regressed[STAGESZ];
+	time_t			 day = 0;
+	char			*urlproj;
+
+	urlproj = url_partx(r->pname, 
+		ksuffixes[KMIME_TEXT_HTML],
+		pages[PAGE_INDEX],
+		valid_keys[VALID_PROJECT_NAME].name,
+		KATTRX_STRING, name, NULL);
+
+	khtml_open(&req, r, 0);
+	hbuf_open(&hb, r);
+	kcgi_writer_disable(r);
+	html_open(&hb, "Trend");
+
+	/* Output header. */
+
+	khtml_elem(&req, KELEM_HEADER);
+	khtml_attr(&req, KELEM_H1, 
+		KATTR_CLASS, "table", KATTR__MAX);
+	khtml_attr(&req, KELEM_A,
+		KATTR_HREF, "index.html", KATTR__MAX);
+	khtml_puts(&req, "Dashboard");
+	khtml_closeelem(&req, 1); /* a */
+	khtml_ncr(&req, 0x203a);
+	khtml_attr(&req, KELEM_A,
+		KATTR_HREF, urlproj, KATTR__MAX);
+	khtml_puts(&req, name);
+	khtml_closeelem(&req, 1); /* a */
+	khtml_ncr(&req, 0x203a);
+	khtml_elem(&req, KELEM_SPAN);
+	if (p != NULL) {
+		get_html_uname(&req, p);
+		khtml_puts(&req, " ");
+	}
+	khtml_puts(&req, "Trend");
+	khtml_closeelem(&req, 1); /* span */
+	khtml_closeelem(&req, 1); /* h1 */
+	khtml_closeelem(&req, 1); /* header */
+
+	/* Output data: header row, then each day. */
+
+	khtml_attr(&req, KELEM_DIV, 
+		KATTR_CLASS, "table trendtable", KATTR__MAX);
+	khtml_attr(&req, KELEM_DIV, 
+		KATTR_CLASS, "row", KATTR__MAX);
+	khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
+		"head report-start", KATTR__MAX);
+	khtml_closeelem(&req, 1); /* cell */
+	khtml_attr(&req, KELEM_DIV, 
+		KATTR_CLASS, "cellgroup", KATTR__MAX);
 	khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
-		"row", KATTR__MAX);
-	khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
-		"head report-successrate", KATTR__MAX);
+		"head report-env", KATTR__MAX);
 	khtml_closeelem(&req, 1); /* cell */
 	khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
-		"head project-name", KATTR__MAX);
+		"head report-deps", KATTR__MAX);
 	khtml_closeelem(&req, 1); /* cell */
 	khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
-		"head report-finished-pct", KATTR__MAX);
+		"head report-build", KATTR__MAX);
 	khtml_closeelem(&req, 1); /* cell */
 	khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
-		"head report-pending", KATTR__MAX);
+		"head report-regress", KATTR__MAX);
 	khtml_closeelem(&req, 1); /* cell */
 	khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
-		"head report-newest", KATTR__MAX);
+		"head report-install", KATTR__MAX);
 	khtml_closeelem(&req, 1); /* cell */
 	khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
-		"head report-commit", KATTR__MAX);
+		"head report-dist", KATTR__MAX);
 	khtml_closeelem(&req, 1); /* cell */
+	khtml_closeelem(&req, 1); /* cellgroup */
 	khtml_closeelem(&req, 1); /* row */
 
-	/* Now each project's data. */
+	memset(count, 0, sizeof(count));
+	memset(total, 0, sizeof(total));
+	memset(regressed, 0, sizeof(regressed));
+
+	TAILQ_FOREACH(ru, rq, _entries) {
+		if (ru->day != day && day != 0) {
+			get_html_trend_row(&req, day, 
+				count, total, regressed);
+			memset(count, 0, sizeof(count));
+			memset(total, 0, sizeof(total));
+			memset(regressed, 0, sizeof(regressed));
+		}
+		day = ru->day;
+		count[ru->stage] += ru->count;
+		total[ru->stage] += ru->total;
+		regressed[ru->stage] += ru->regressed;
+	}
+	if (day != 0)
+		get_html_trend_row(&req, day, count, total, regressed);
+
+	khtml_closeelem(&req, 1); /* table */
+	khtml_close(&req);
+	html_close(&hb);
+}
+
+/*
+ * Print the rollup of a trend as JSON.
+ */
+static void
+get_trend_json(struct kreq *r, const struct rollup_q *rq)
+{
+	struct kjsonreq	 req;
+
+	kjson_open(&req, r);
+	kcgi_writer_disable(r);
+	kjson_obj_open(&req);
+	json_rollup_array(rq, &req);
+	kjson_obj_close(&req);
+	kjson_close(&req);
+}
+
+/*
+ * Trend of stage durations over the TRENDDAYS up to today, for all
+ * machines of a project or, if also given report.machineid, a machine
+ * for a project.
+ * This reads only the rollup, not reports.
+ * Outputs HTTP 404 (not found) or 200 (success).
+ */
+static void
+get_trend(struct kreq *r)
+{
+	struct kpair	*kpn, *kpm;
+	struct project	*proj;
+	struct report	*p = NULL;
+	struct scope	*sc;
+	struct rollup_q	*rq;
+	struct tag	 tag;
+	char		*name;
+	time_t		 since;
+
+	kpn = r->fieldmap[VALID_PROJECT_NAME];
+	kpm = r->fieldmap[VALID_REPORT_MACHINEID];
+
+	if (kpn == NULL || (proj = db_project_get_byname
+	    (r->arg, kpn->parsed.s)) == NULL) {
+		http_open(r, KHTTP_404, KMIME__MAX, NULL);
+		return;
+	}
+
+	/* 
+	 * Use the same validators as the listings, but as the window
+	 * of days moves on each day, with today as well.
+	 */
+
+	since = time(NULL);
+	since -= since % 86400;
+
+	if (kpm != NULL) {
+		p = db_report_get_latest(r->arg, 
+			proj->id, /* projectid */
+			kpm->parsed.i); /* machineid */
+		if (p == NULL) {
+			http_open(r, KHTTP_404, KMIME__MAX, NULL);
+			db_project_free(proj);
+			return;
+		}
+		tag.id = p->id;
+		tag.mtime = p->ctime;
+	} else {
+		name = arena_printf("project/%s", proj->name);
+		sc = db_scope_get_byname(r->arg, name);
+		tag.id = sc == NULL ? 0 : sc->lastid;
+		tag.mtime = sc == NULL ? 0 : sc->mtime;
+		db_scope_free(sc);
+	}
+
+	tag.day = since;
+	if (tag.mtime < since)
+		tag.mtime = since;
+
+	if (http_fresh(r, &tag)) {
+		db_project_free(proj);
+		db_report_free(p);
+		return;
+	}
+
+	since -= (TRENDDAYS - 1) * 86400;
+
+	rq = p != NULL ?
+		db_rollup_list_bymachine(r->arg, 
+			proj->id, /* projectid */
+			p->machineid, /* machineid */
+			since) : /* day ge */
+		db_rollup_list_byproject(r->arg, 
+			proj->id, /* projectid */
+			since); /* day ge */
+
+	http_open(r, KHTTP_200, r->mime, &tag);
+	if (r->mime == KMIME_APP_JSON)
+		get_trend_json(r, rq);
+	else
+		get_trend_html(r, rq, proj->name, p);
+
+	db_rollup_freeq(rq);
+	db_project_free(proj);
+	db_report_free(p);
+}
+
+/*
+ * Get the name of the scope (see the scope structure) of the reports
+ * listed by this request, or NULL if it's a single report.
+ * The name is allocated from the arena.
+ */
+static const char *
+scope_get(const struct kreq *r)
+{
+	const char	*name = NULL;
+
+	if (r->fieldmap[VALID_REPORT_ID] != NULL)
+		return NULL;
+	else if (r->fieldmap[VALID_PROJECT_NAME] != NULL)
+		name = arena_printf("project/%s",
+			r->fieldmap[VALID_PROJECT_NAME]->parsed.s);
+	else if (r->fieldmap[VALID_REPORT_MACHINEID] != NULL)
+		name = arena_printf("machine/%" PRId64,
+			r->fieldmap[VALID_REPORT_MACHINEID]->parsed.i);
+	else if (r->fieldmap[VALID_REPORT_CTIME] != NULL)
+		name = arena_printf("date/%" PRId64,
+			r->fieldmap[VALID_REPORT_CTIME]->parsed.i);
+	else
+		name = "index";
+
+	return name;
+}
+
+/*
+ * List one or more records.
+ * Listings are first checked against their scope's validators.
+ */
+static void
+get(struct kreq *r)
+{
+	struct scope	*sc = NULL;
+	struct tag	 tag;
+	const char	*name;
+
+	timing_phase(PHASE_SQL);
+
+	if (r->page == PAGE_TREND) {
+		get_trend(r);
+		return;
+	} else if (r->page == PAGE_LOG) {
+		get_log(r);
+		return;
+	} else if ((name = scope_get(r)) == NULL) {
+		get_single(r);
+		return;
+	}
+
+	sc = db_scope_get_byname(r->arg, name);
+
+	tag.id = sc == NULL ? 0 : sc->lastid;
+	tag.mtime = sc == NULL ? 0 : sc->mtime;
+	tag.day = 0;
+	db_scope_free(sc);
+
+	if (http_fresh(r, &tag))
+		return;
+
+	if (r->fieldmap[VALID_PROJECT_NAME] == NULL &&
+	    r->fieldmap[VALID_REPORT_MACHINEID] == NULL &&
+	    r->fieldmap[VALID_REPORT_CTIME] == NULL) {
+		if (r->mime == KMIME_APP_JSON)
+			get_dash_json(r, &tag);
+		else
+			get_dash(r, &tag);
+	} else if (r->mime == KMIME_APP_JSON)
+		get_last_json(r, &tag);
+	else
+		get_last(r, &tag);
+}
+
+/*
+ * Compute the cache key of a GET request from its page, content type,
+ * query fields, and whether it may be compressed, all salted with the
+ * current cache generation (see cache_bump()).
+ * Trends also change with the day (see get_trend()).
+ * Returns zero if the request may not be cached (or answered from the
+ * cache), non-zero otherwise.
+ */
+static int
+cache_key(const struct kreq *r, char *key)
+{
+	MD5_CTX		 ctx;
+	char		 gen[64], buf[64];
+	ssize_t		 ssz = 0;
+	size_t		 i;
+	int		 fd;
+
+	if (r->method != KMETHOD_GET || !cache_enabled())
+		return 0;
+
+	/* 
+	 * Responses to ranges are partial and those to conditional
+	 * requests may be empty, neither of which is in the key.
+	 * Conditional requests go to the database anyway, as their
+	 * validators are cheaper to check than sending the response.
+	 */
+
+	if (r->reqmap[KREQU_RANGE] != NULL || http_conditional(r))
+		return 0;
+
+	/* No generation means nothing has been posted yet. */
+
+	if ((fd = open(CACHEDIR "/generation", O_RDONLY)) != -1) {
+		ssz = read(fd, gen, sizeof(gen));
+		close(fd);
+		if (ssz == -1)
+			return 0;
+	} else if (errno != ENOENT)
+		return 0;
+
+	snprintf(buf, sizeof(buf), "|%zu|%zu|%d|%lld|", 
+		r->page, r->mime, http_gzip(r), r->page == PAGE_TREND ?
+		(long long)(time(NULL) / 86400) : 0LL);
+
+	MD5Init(&ctx);
+	MD5Update(&ctx, gen, ssz);
+	MD5Update(&ctx, buf, strlen(buf));
+	for (i = 0; i < r->fieldsz; i++) {
+		MD5Update(&ctx, r->fields[i].key, 
+			strlen(r->fields[i].key));
+		MD5Update(&ctx, "=", 1);
+		MD5Update(&ctx, r->fields[i].val, r->fields[i].valsz);
+		MD5Update(&ctx, "&", 1);
+	}
+	MD5End(&ctx, key);
+	return 1;
+}
+
+/*
+ * Copy the open file "fd" to the standard output.
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+cache_copy(int fd)
+{
+	char	 buf[BUFSIZ];
+	ssize_t	 ssz;
+
+	while ((ssz = read(fd, buf, sizeof(buf))) > 0) {
+		if (write(STDOUT_FILENO, buf, ssz) != ssz)
+			return 0;
+		timing.bytes += ssz;
+	}
+
+	return ssz == 0;
+}
+
+/*
+ * Write the cached response for "key", if there is one, directly to
+ * the standard output: it's a full CGI response, headers and all.
+ * Only 200 responses are cached (see cache_fill_close()).
+ * Returns zero if not found, non-zero if sent.
+ */
+static int
+cache_send(const char *key)
+{
+	char	 path[PATH_MAX];
+	int	 fd, rc;
+
+	timing_phase(PHASE_CACHE);
+	snprintf(path, sizeof(path), CACHEDIR "/%s", key);
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		timing_phase(PHASE__MAX);
+		return 0;
+	}
+	timing.code = KHTTP_200;
+	rc = cache_copy(fd);
+	close(fd);
+	if (!rc)
+		warn("%s", path);
+	timing_phase(PHASE__MAX);
+	return 1;
+}
+
+/*
+ * Start rendering the response for "key" into the cache by pointing
+ * the standard output at a temporary file.
+ * Returns zero on failure (the response is just not cached), non-zero
+ * if cache_fill_close() must be called after the response is done.
+ */
+static int
+cache_fill_open(struct cache *c, const char *key)
+{
+
+	snprintf(c->path, sizeof(c->path), CACHEDIR "/%s", key);
+	strlcpy(c->tmp, CACHEDIR "/tmp.XXXXXXXXXX", sizeof(c->tmp));
+
+	if ((c->fd = mkstemp(c->tmp)) == -1) {
+		warn("%s", c->tmp);
+		return 0;
+	}
+
+	fflush(stdout);
+	if ((c->stdfd = dup(STDOUT_FILENO)) == -1 ||
+	    dup2(c->fd, STDOUT_FILENO) == -1) {
+		warn("dup");
+		if (c->stdfd != -1)
+			close(c->stdfd);
+		close(c->fd);
+		unlink(c->tmp);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Finish a response started with cache_fill_open().
+ * This must be called after khttp_free(), which finishes the output.
+ * The response is moved into the cache, if it's a 200, and copied to
+ * the real output.
+ */
+static void
+cache_fill_close(struct cache *c)
+{
+	char	 buf[12];
+
+	fflush(stdout);
+	if (dup2(c->stdfd, STDOUT_FILENO) == -1)
+		err(EXIT_FAILURE, "dup2");
+	close(c->stdfd);
+
+	if (pread(c->fd, buf, sizeof(buf), 0) != sizeof(buf) ||
+	    memcmp(buf, "Status: 200 ", sizeof(buf)))
+		unlink(c->tmp);
+	else if (rename(c->tmp, c->path) == -1) {
+		warn("%s", c->path);
+		unlink(c->tmp);
+	}
+
+	if (lseek(c->fd, 0, SEEK_SET) == -1 || !cache_copy(c->fd))
+		warn("%s", c->path);
+	close(c->fd);
+}
+
+/*
+ * Validate the uname -v of a submission, which isn't an ORT field of
+ * report (see reportdetail) but has the same limits as the others.
+ */
+static int
+valid_unamev(struct kpair *kp)
+{
+
+	return kvalid_string(kp) && kp->valsz <= 128;
+}
+
+/*
+ * Validate the 32-byte signature of a submission.
+ */
+static int
+valid_signature(struct kpair *kp)
+{
+
+	return kvalid_stringne(kp) && kp->valsz == 32;
+}
+
+/*
+ * Get a field of a submission.
+ * If "n" is negative, this is the only report of the request and the
+ * field is "key"; otherwise, it's the n-th report of a batch and the
+ * field is "key.n".
+ * Returns NULL if not found or not valid.
+ */
+static struct kpair *
+submit_field(struct kreq *r, int n, 
+	const char *key, int (*valid)(struct kpair *))
+{
+	char	 buf[64];
+
+	if (n < 0)
+		return field_get(r, key, valid);
+	snprintf(buf, sizeof(buf), "%s.%d", key, n);
+	return field_get(r, buf, valid);
+}
+
+/*
+ * Like submit_field() but for an ORT field, which for single reports
+ * has already been validated.
+ */
+static struct kpair *
+submit_key(struct kreq *r, int n, size_t key)
+{
+
+	if (n < 0)
+		return r->fieldmap[key];
+	return submit_field(r, n, 
+		valid_keys[key].name, valid_keys[key].valid);
+}
+
+/*
+ * Validate a stage's resource usage: the non-negative wall, user, and
+ * system milliseconds, peak kilobytes resident, and blocks in and out,
+ * separated by commas.
+ */
+static int
+valid_metrics(struct kpair *kp)
+{
+	int64_t	 v[6];
+	int	 end = 0;
+	size_t	 i;
+
+	if (!kvalid_stringne(kp) ||
+	    sscanf(kp->parsed.s, "%" SCNd64 ",%" SCNd64 ",%" SCNd64 
+	    ",%" SCNd64 ",%" SCNd64 ",%" SCNd64 "%n", &v[0], &v[1], 
+	    &v[2], &v[3], &v[4], &v[5], &end) != 6 ||
+	    kp->parsed.s[end] != '\0')
+		return 0;
+	for (i = 0; i < 6; i++)
+		if (v[i] < 0)
+			return 0;
+	return 1;
+}
+
+/*
+ * Get the fields of a submission (see submit_field() for "n").
+ * Records are signed into a non-ORT field "signature".
+ * Stages' resource usage is in the optional non-ORT "metrics-" fields
+ * named in stages.
+ * The log, uname, and commit keep their report names for
+ * compatibility, though they're now in logblob, machine, reportdetail,
+ * and revision.
+ * Returns zero if any are missing or invalid.
+ */
+static int
+submit_get(struct kreq *r, int n, struct submit *s)
+{
+	size_t	 i;
+	char	 key[32];
+
+	memset(s, 0, sizeof(struct submit));
+
+	/* Resource usage of each stage is optional. */
+
+	for (i = 0; i < STAGESZ; i++) {
+		snprintf(key, sizeof(key), 
+			"metrics-%s", stages[i].name);
+		s->kpm[i] = submit_field(r, n, key, valid_metrics);
+	}
+
+	s->sig = submit_field(r, n, "signature", valid_signature);
+	s->kpl = submit_field(r, n, "report-log", kvalid_string);
+	s->kpuv = submit_field(r, n, "report-unamev", valid_unamev);
+
+	return s->sig != NULL && s->kpl != NULL && s->kpuv != NULL &&
+	    (s->kpn = submit_key(r, n, VALID_PROJECT_NAME)) != NULL &&
+	    (s->kpd = submit_key(r, n, VALID_REPORT_DEPEND)) != NULL &&
+	    (s->kpc = submit_key(r, n, VALID_REPORT_DISTCHECK)) != NULL &&
+	    (s->kpe = submit_key(r, n, VALID_REPORT_ENV)) != NULL &&
+	    (s->kpf = submit_field(r, n, "report-fetchhead",
+	     valid_keys[VALID_REVISION_HASH].valid)) != NULL &&
+	    (s->kpi = submit_key(r, n, VALID_REPORT_INSTALL)) != NULL &&
+	    (s->kps = submit_key(r, n, VALID_REPORT_START)) != NULL &&
+	    (s->kpb = submit_key(r, n, VALID_REPORT_BUILD)) != NULL &&
+	    (s->kpt = submit_key(r, n, VALID_REPORT_TEST)) != NULL &&
+	    (s->kpum = submit_field(r, n, "report-unamem",
+	     valid_keys[VALID_MACHINE_UNAMEM].valid)) != NULL &&
+	    (s->kpun = submit_field(r, n, "report-unamen",
+	     valid_keys[VALID_MACHINE_UNAMEN].valid)) != NULL &&
+	    (s->kpur = submit_field(r, n, "report-unamer",
+	     valid_keys[VALID_MACHINE_UNAMER].valid)) != NULL &&
+	    (s->kpus = submit_field(r, n, "report-unames",
+	     valid_keys[VALID_MACHINE_UNAMES].valid)) != NULL;
+}
+
+/*
+ * Check a submission from submit_get() made by "user".
+ * This performs all sanity checks: failure is sequentially consistent,
+ * timestamps are increasing, the signature matches, etc.
+ * On success, this fills in the project and the uname and log digests.
+ * Returns NULL on success or the reason for failure.
+ */
+static const char *
+submit_check(struct kreq *r, struct submit *s, const struct user *user)
+{
+	size_t		 i;
+	MD5_CTX		 ctx;
+	const char	*buf, *metrics = "";
+	char		 digest[MD5_DIGEST_STRING_LENGTH];
+
+	/* 
+	 * Check that if stages fail, subsequent must also fail. 
+	 * Also, the log should only be specified on failure.
+	 */
+
+	if ((s->kpe->parsed.i == 0 &&
+	     (s->kpd->parsed.i != 0 ||
+	      s->kpb->parsed.i != 0 ||
+	      s->kpt->parsed.i != 0 ||
+	      s->kpi->parsed.i != 0 ||
+	      s->kpc->parsed.i != 0)) ||
+	    (s->kpd->parsed.i == 0 &&
+	     (s->kpb->parsed.i != 0 ||
+	      s->kpt->parsed.i != 0 ||
+	      s->kpi->parsed.i != 0 ||
+	      s->kpc->parsed.i != 0)) ||
+	    (s->kpb->parsed.i == 0 &&
+	     (s->kpt->parsed.i != 0 ||
+	      s->kpi->parsed.i != 0 ||
+	      s->kpc->parsed.i != 0)) ||
+	    (s->kpt->parsed.i == 0 &&
+	     (s->kpi->parsed.i != 0 ||
+	      s->kpc->parsed.i != 0)) ||
+	    (s->kpi->parsed.i == 0 &&
+	     (s->kpc->parsed.i != 0)) ||
+	    (s->kpc->parsed.i != 0 && s->kpl->valsz))
+		return "invalid stages";
+
+	/* 
+	 * Check that times must increase.
+	 * FIXME: the minci.sh script uses `date +%s` to create
+	 * timestamps, which of course aren't guaranteed to increase
+	 * (though it's unlikely they won't).
+	 */
+
+	if ((s->kpe->parsed.i != 0 && 
+	     s->kpe->parsed.i < s->kps->parsed.i) ||
+	    (s->kpd->parsed.i != 0 && 
+	     s->kpd->parsed.i < s->kpe->parsed.i) ||
+	    (s->kpb->parsed.i != 0 && 
+	     s->kpb->parsed.i < s->kpd->parsed.i) ||
+	    (s->kpt->parsed.i != 0 && 
+	     s->kpt->parsed.i < s->kpb->parsed.i) ||
+	    (s->kpi->parsed.i != 0 && 
+	     s->kpi->parsed.i < s->kpt->parsed.i) ||
+	    (s->kpc->parsed.i != 0 && 
+	     s->kpc->parsed.i < s->kpi->parsed.i))
+		return "invalid timestamp sequence";
+
+	/* Hash log digest (may be zero-length). */
+
+	MD5Init(&ctx);
+	MD5Update(&ctx, s->kpl->parsed.s, s->kpl->valsz);
+	MD5End(&ctx, s->logdigest);
+
+	/* Get the project. */
+
+	s->proj = db_project_get_byname(r->arg,
+		s->kpn->parsed.s); /* name */
+	if (s->proj == NULL)
+		return "invalid project";
+
+	/* 
+	 * Re-create the signature with the user's secret key.
+	 * This authenticates the message.
+	 * Resource usage, if given, comes first by key order.
+	 */
+
+	for (i = 0; i < STAGESZ; i++) {
+		if (s->kpm[i] == NULL)
+			continue;
+		metrics = arena_printf("%smetrics-%s=%s&", metrics,
+			stages[i].name, s->kpm[i]->parsed.s);
+	}
+
+	buf = arena_printf(
+		"%s"
+		"project-name=%s&"
+		"report-build=%" PRId64 "&"
+		"report-distcheck=%" PRId64 "&"
+		"report-env=%" PRId64 "&"
+		"report-fetchhead=%s&"
+		"report-depend=%" PRId64 "&"
+		"report-install=%" PRId64 "&"
+		"report-log=%s&"
+		"report-start=%" PRId64 "&"
+		"report-test=%" PRId64 "&"
+		"report-unamem=%s&"
+		"report-unamen=%s&"
+		"report-unamer=%s&"
+		"report-unames=%s&"
+		"report-unamev=%s&"
+		"user-apisecret=%s",
+		metrics,
+		s->proj->name,
+		s->kpb->parsed.i,
+		s->kpc->parsed.i,
+		s->kpe->parsed.i,
+		s->kpf->parsed.s,
+		s->kpd->parsed.i,
+		s->kpi->parsed.i,
+		s->logdigest,
+		s->kps->parsed.i,
+		s->kpt->parsed.i,
+		s->kpum->parsed.s,
+		s->kpun->parsed.s,
+		s->kpur->parsed.s,
+		s->kpus->parsed.s,
+		s->kpuv->parsed.s,
+		user->apisecret);
+	MD5Init(&ctx);
+	MD5Update(&ctx, buf, strlen(buf));
+	MD5End(&ctx, digest);
+
+	if (strcasecmp(digest, s->sig->parsed.s))
+		return "bad signature";
+
+	/* Lastly, hash the uname to find the machine (see machine.hash). */
+
+	buf = arena_printf("%s|%s|%s|%s|%s",
+		s->kpum->parsed.s, s->kpun->parsed.s, 
+		s->kpur->parsed.s, s->kpus->parsed.s, 
+		s->kpuv->parsed.s);
+	MD5Init(&ctx);
+	MD5Update(&ctx, buf, strlen(buf));
+	MD5End(&ctx, s->unamedigest);
+
+	return NULL;
+}
+
+/*
+ * Process a record submission (see submit_get() and submit_check()).
+ * If spooling (see spool_enabled()), it's written to the spool for the
+ * committer instead of being inserted.
+ * It outputs only HTTP 403 (error), 201 (inserted), and 202 (spooled).
+ */
+static void
+post(struct kreq *r)
+{
+	struct user	*user = NULL;
+	struct submit	 s;
+	struct kpair	*kpu;
+	const char	*er;
+	char		 tmp[PATH_MAX];
+
+	timing_phase(PHASE_SQL);
+
+	if (!submit_get(r, -1, &s) ||
+	    (kpu = r->fieldmap[VALID_USER_APIKEY]) == NULL) {
+		kutil_warnx(r, NULL, "invalid request");
+		http_open(r, KHTTP_403, KMIME__MAX, NULL);
+		goto out;
+	}
+
+	user = db_user_get_bykey(r->arg,
+		kpu->parsed.i); /* apikey */
+	if (user == NULL) {
+		kutil_warnx(r, NULL, "invalid user");
+		http_open(r, KHTTP_403, KMIME__MAX, NULL);
+		goto out;
+	}
+
+	if ((er = submit_check(r, &s, user)) != NULL) {
+		kutil_warnx(r, user->email, "%s", er);
+		http_open(r, KHTTP_403, KMIME__MAX, NULL);
+		goto out;
+	}
+
+	if (spool_enabled()) {
+		if (!spool_write(&s, user->id, time(NULL), 
+		    tmp, sizeof(tmp)) || !spool_commit(tmp)) {
+			kutil_warnx(r, user->email, "spool failed");
+			http_open(r, KHTTP_403, KMIME__MAX, NULL);
+			goto out;
+		}
+		kutil_info(r, user->email, 
+			"log spooled: %s", s.proj->name);
+		timing.rows++;
+		http_open(r, KHTTP_202, KMIME__MAX, NULL);
+		goto out;
+	}
+
+	db_trans_open(r->arg, 1, 1);
+	if (submit_insert(r->arg, &s, user->id, time(NULL)) == -1) {
+		db_trans_rollback(r->arg, 1);
+		kutil_warnx(r, user->email, "insert failed");
+		http_open(r, KHTTP_403, KMIME__MAX, NULL);
+		goto out;
+	}
+	db_trans_commit(r->arg, 1);
+	cache_bump();
+
+	kutil_info(r, user->email, "log submitted: %s", s.proj->name);
+	timing.rows++;
+	http_open(r, KHTTP_201, KMIME__MAX, NULL);
+out:
+	db_project_free(s.proj);
+	db_user_free(user);
+}
+
+/*
+ * Process a batch of record submissions, numbered from zero as
+ * described in submit_field(), all made by the user of the
+ * "user-apikey" field.
+ * Each is checked as in post(); those passing are inserted in a single
+ * transaction or, if spooling, written to the spool all or none (but
+ * each committed to it on its own, so failing alone).
+ * It outputs HTTP 413 if there are more than BATCHMAX submissions, 403
+ * if the request is otherwise malformed or the transaction fails, else
+ * HTTP 201 (202 if spooled) with a JSON array "report" of each
+ * submission's status: whether "ok", with the report "id" if so and
+ * inserted, else the "error".
+ */
+static void
+post_batch(struct kreq *r)
+{
+	struct user	*user = NULL;
+	struct submit	*s;
+	const char	*er[BATCHMAX];
+	int64_t		 id[BATCHMAX];
+	char		(*tmp)[PATH_MAX];
+	struct kpair	*kpu;
+	struct kjsonreq	 req;
+	time_t		 ctime;
+	size_t		 i, j, sz, ok = 0;
+	int		 spool;
+
+	timing_phase(PHASE_SQL);
+
+	/* The batch ends with the first missing project name. */
+
+	for (sz = 0; sz < BATCHMAX; sz++)
+		if (submit_field(r, sz, "project-name", 
+		    kvalid_string) == NULL)
+			break;
+
+	if (sz == BATCHMAX && submit_field(r, sz, 
+	    "project-name", kvalid_string) != NULL) {
+		kutil_warnx(r, NULL, "batch too large");
+		http_open(r, KHTTP_413, KMIME__MAX, NULL);
+		return;
+	}
+
+	if (sz == 0 || 
+	    (kpu = r->fieldmap[VALID_USER_APIKEY]) == NULL) {
+		kutil_warnx(r, NULL, "invalid request");
+		http_open(r, KHTTP_403, KMIME__MAX, NULL);
+		return;
+	}
+
+	user = db_user_get_bykey(r->arg,
+		kpu->parsed.i); /* apikey */
+	if (user == NULL) {
+		kutil_warnx(r, NULL, "invalid user");
+		http_open(r, KHTTP_403, KMIME__MAX, NULL);
+		return;
+	}
+
+	/* These are too big for the stack of a full batch. */
+
+	s = kcalloc(sz, sizeof(struct submit));
+	tmp = kcalloc(sz, sizeof(*tmp));
+
+	for (i = 0; i < sz; i++) {
+		id[i] = -1;
+		if (!submit_get(r, i, &s[i]))
+			er[i] = "invalid request";
+		else
+			er[i] = submit_check(r, &s[i], user);
+		if (er[i] != NULL)
+			kutil_warnx(r, user->email, 
+				"batch item %zu: %s", i, er[i]);
+		else
+			ok++;
+	}
+
+	/* 
+	 * Write all good submissions to the spool or none, then commit
+	 * them so that the committer sees them.  Commits can't be undone
+	 * once others are seen, so one that fails only fails its own
+	 * submission.
+	 */
 
-	for (i = 0; i < dashsz; i++) {
-		urlproj = khttp_urlpartx(r->pname, 
-			ksuffixes[KMIME_TEXT_HTML],
-			pages[PAGE_INDEX],
-			valid_keys[VALID_PROJECT_NAME].name,
-			KATTRX_STRING, dash[i].proj->name, NULL);
-		kasprintf(&urlcommit, "%s/%s/tree/%s",
-			COMMIT_BASE, dash[i].proj->name,
-			dash[i].nhash);
+	if ((spool = spool_enabled()) && ok > 0) {
+		ctime = time(NULL);
+		for (i = 0; i < sz; i++)
+			if (er[i] == NULL && !spool_write
+			    (&s[i], user->id, ctime, tmp[i], sizeof(*tmp)))
+				break;
+		if (i < sz) {
+			for (j = 0; j < i; j++)
+				if (er[j] == NULL)
+					unlink(tmp[j]);
+			kutil_warnx(r, user->email, "spool failed");
+			http_open(r, KHTTP_403, KMIME__MAX, NULL);
+			goto out;
+		}
+		for (i = 0; i < sz; i++)
+			if (er[i] == NULL && !spool_commit(tmp[i])) {
+				er[i] = "spool failed";
+				kutil_warnx(r, user->email, 
+					"batch item %zu: %s", i, er[i]);
+				ok--;
+			}
+	}
 
-		assert(dash[i].finished + dash[i].pending > 0);
+	/* Insert all good submissions or none. */
 
-		khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
-			"row", KATTR__MAX);
+	if (!spool && ok > 0) {
+		ctime = time(NULL);
+		db_trans_open(r->arg, 1, 1);
+		for (i = 0; i < sz; i++)
+			if (er[i] == NULL &&
+			    (id[i] = submit_insert
+			     (r->arg, &s[i], user->id, ctime)) == -1)
+				break;
+		if (i < sz) {
+			db_trans_rollback(r->arg, 1);
+			kutil_warnx(r, user->email, "insert failed");
+			http_open(r, KHTTP_403, KMIME__MAX, NULL);
+			goto out;
+		}
+		db_trans_commit(r->arg, 1);
+		cache_bump();
+	}
 
-		khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
-			"cell report-successrate", KATTR__MAX);
-		khtml_attr(&req, KELEM_SPAN, KATTR_CLASS, 
-			dash[i].success == dash[i].finished ?
-			"report-pass" : "report-fail",
-			KATTR__MAX);
-		khtml_int(&req,
-			dash[i].finished == 0 ? 0 : floor
-			(100 * dash[i].success / dash[i].finished));
-		khtml_closeelem(&req, 1); /* span */
-		khtml_closeelem(&req, 1); /* cell */
+	kutil_info(r, user->email, "batch %s: %zu of %zu reports", 
+		spool ? "spooled" : "submitted", ok, sz);
+	timing.rows += ok;
 
-		khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
-			"cell project-name", KATTR__MAX);
-		khtml_attr(&req, KELEM_A, KATTR_HREF, 
-			urlproj, KATTR__MAX);
-		khtml_puts(&req, dash[i].proj->name);
-		khtml_closeelem(&req, 1); /* a */
-		khtml_closeelem(&req, 1); /* cell */
-
-		khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
-			"cell report-finished-pct", KATTR__MAX);
-		khtml_int(&req, floor
-			(100 * dash[i].finished / maxdone));
-		khtml_closeelem(&req, 1); /* cell */
-
-		khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
-			"cell report-pending", KATTR__MAX);
-		khtml_int(&req, dash[i].finished);
-		khtml_closeelem(&req, 1); /* cell */
-
-		khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
-			"cell report-newest", KATTR__MAX);
-		gmtime_r(&dash[i].nctime, &tm);
-		strftime(datebuf, sizeof(datebuf), "%F %T", &tm);
-		khtml_puts(&req, datebuf);
-		khtml_closeelem(&req, 1); /* cell */
-
-		khtml_attr(&req, KELEM_DIV, KATTR_CLASS, 
-			"cell report-commit", KATTR__MAX);
-		khtml_attr(&req, KELEM_A, KATTR_HREF, 
-			urlcommit, KATTR__MAX);
-		strlcpy(commitshort, dash[i].nhash, sizeof(commitshort));
-		khtml_puts(&req, commitshort);
-		khtml_closeelem(&req, 1); /* a */
-		khtml_closeelem(&req, 1); /* cell */
+	http_open(r, spool ? KHTTP_202 : KHTTP_201, KMIME_APP_JSON, NULL);
+	kjson_open(&req, r);
+	kcgi_writer_disable(r);
+	kjson_obj_open(&req);
+	kjson_arrayp_open(&req, "report");
+	for (i = 0; i < sz; i++) {
+		kjson_obj_open(&req);
+		kjson_putboolp(&req, "ok", er[i] == NULL);
+		if (er[i] == NULL && !spool)
+			kjson_putintp(&req, "id", id[i]);
+		else if (er[i] != NULL)
+			kjson_putstringp(&req, "error", er[i]);
+		kjson_obj_close(&req);
+	}
+	kjson_array_close(&req);
+	kjson_obj_close(&req);
+	kjson_close(&req);
+out:
+	for (i = 0; i < sz; i++)
+		db_project_free(s[i].proj);
+	free(s);
+	free(tmp);
+	db_user_free(user);
+}
+
+/*
+ * Checks common to all requests before the database is touched: that
+ * the page is known and whether the client's copy of a report, which
+ * never changes, is still good.
+ * Returns zero if the request has been answered, non-zero if it should
+ * continue to the database.
+ */
+static int
+preamble(struct kreq *r)
+{
+	struct kpair	*kp;
+	struct tag	 tag;
+	char		 etag[64];
 
-		khtml_closeelem(&req, 1); /* row */
-		free(urlproj);
-		free(urlcommit);
+	if (r->page == PAGE__MAX ||
+	    (r->page == PAGE_BATCH && r->method != KMETHOD_POST)) {
+		http_open(r, KHTTP_404, KMIME__MAX, NULL);
+		return 0;
 	}
 
-	khtml_closeelem(&req, 1); /* table */
-	khtml_elem(&req, KELEM_FOOTER);
-	khtml_attr(&req, KELEM_A,
-		KATTR_HREF, REPO_BASE "/minci", KATTR__MAX);
-	khtml_puts(&req, "minci");
-	khtml_closeelem(&req, 1); /* a */
-	khtml_closeelem(&req, 1); /* footer */
-	khtml_closeelem(&req, 1); /* body */
-	khtml_closeelem(&req, 1); /* html */
-	khtml_close(&req);
+	if (r->method == KMETHOD_GET &&
+	    (kp = r->fieldmap[VALID_REPORT_ID]) != NULL &&
+	    r->reqmap[KREQU_IF_NONE_MATCH] != NULL) {
+		tag.id = kp->parsed.i;
+		tag.mtime = 0;
+		tag.day = 0;
+		http_etag(r, &tag, etag, sizeof(etag));
+		if (strstr(r->reqmap[KREQU_IF_NONE_MATCH]->val, 
+		    etag) != NULL) {
+			http_open(r, KHTTP_304, r->mime, &tag);
+			return 0;
+		}
+	}
 
-	db_report_freeq(rq);
-	free(dash);
+	return 1;
 }
 
 /*
- * List the last *n* records, sorted by time of accept.
- * Always outputs HTTP 200.
+ * Switch on method, not resource.
+ * The database must already be in the role matching the method.
+ * Strings built for the request are freed once it's done.
  */
 static void
-get_last(struct kreq *r, time_t mtime)
+dispatch(struct kreq *r, struct ort *db)
 {
-	struct req	 req;
-	struct kpair	*kpn, *kpd, *kph;
-	time_t		 t;
-	struct tm	 tm;
-	char		 datebuf[32];
 
-	memset(&req, 0, sizeof(struct req));
+	r->arg = db;
+	if (r->method == KMETHOD_POST && r->page == PAGE_BATCH)
+		post_batch(r);
+	else if (r->method == KMETHOD_POST)
+		post(r);
+	else
+		get(r);
+	arena_free();
+}
 
-	kpn = r->fieldmap[VALID_PROJECT_NAME];
-	kpd = r->fieldmap[VALID_REPORT_CTIME];
-	kph = r->fieldmap[VALID_REPORT_UNAMEHASH];
+/*
+ * Render the report or listing "name", named as the scopes in
+ * scope_get(), into STATICDIR as "name.html".
+ * The page is rendered by passing the "query" to get() as a CGI request
+ * whose output is pointed at a temporary file.
+ * Its headers are then stripped and the rest renamed into place.
+ * Returns zero on failure, non-zero on success (or if there's no such
+ * page).
+ */
+static int
+render_page(struct ort *db, const char *name, const char *query)
+{
+	struct kreq	 r;
+	struct stat	 st;
+	enum kcgi_err	 er;
+	char		 tmp[PATH_MAX], path[PATH_MAX], 
+			 dir[PATH_MAX], *buf = NULL, *cp;
+	ssize_t		 ssz;
+	int		 fd, stdfd, rc = 0;
+
+	/* Reports and listings by scope each have a directory. */
+
+	if ((cp = strchr(name, '/')) != NULL) {
+		snprintf(dir, sizeof(dir), STATICDIR "/%.*s",
+			(int)(cp - name), name);
+		if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+			warn("%s", dir);
+			return 0;
+		}
+	}
 
-	assert(kpn != NULL || kpd != NULL || kph != NULL);
+	snprintf(path, sizeof(path), STATICDIR "/%s.html", name);
+	strlcpy(tmp, STATICDIR "/tmp.XXXXXXXXXX", sizeof(tmp));
 
-	/* Open output page. */
+	if ((fd = mkstemp(tmp)) == -1) {
+		warn("%s", tmp);
+		return 0;
+	}
 
-	http_open(r, KHTTP_200, r->mime, mtime);
-	req.r = r;
-	khtml_open(&req.html, r, 0);
-	kcgi_writer_disable(r);
-	html_open(&req.html, "Reports");
+	if (setenv("QUERY_STRING", query, 1) == -1) {
+		warn("setenv");
+		goto out;
+	}
 
-	/* Output header. */
+	fflush(stdout);
+	if ((stdfd = dup(STDOUT_FILENO)) == -1) {
+		warn("dup");
+		goto out;
+	} else if (dup2(fd, STDOUT_FILENO) == -1) {
+		warn("dup2");
+		close(stdfd);
+		goto out;
+	}
 
-	khtml_elem(&req.html, KELEM_HEADER);
-	khtml_attr(&req.html, KELEM_H1, 
-		KATTR_CLASS, "table", KATTR__MAX);
+	er = khttp_parse(&r, valid_keys,
+		VALID__MAX, pages, PAGE__MAX, PAGE_INDEX);
+	if (er == KCGI_OK) {
+		r.arg = db;
+		get(&r);
+		khttp_free(&r);
+	}
+	arena_free();
 
-	if (kpn != NULL) {
-		khtml_attr(&req.html, KELEM_A,
-			KATTR_HREF, "index.html", KATTR__MAX);
-		khtml_puts(&req.html, "Dashboard");
-		khtml_closeelem(&req.html, 1); /* a */
-		khtml_ncr(&req.html, 0x203a);
-		khtml_elem(&req.html, KELEM_SPAN);
-		khtml_puts(&req.html, kpn->parsed.s);
-		khtml_closeelem(&req.html, 1); /* span */
-		khtml_closeelem(&req.html, 1); /* h1 */
-		req.checkhash = 1;
-	} else if (kph != NULL) {
-		khtml_attr(&req.html, KELEM_A,
-			KATTR_HREF, "index.html", KATTR__MAX);
-		khtml_puts(&req.html, "Dashboard");
-		khtml_closeelem(&req.html, 1); /* a */
-		khtml_ncr(&req.html, 0x203a);
-		khtml_elem(&req.html, KELEM_SPAN);
-		khtml_puts(&req.html, "Machine Dashboard");
-		khtml_closeelem(&req.html, 1); /* span */
-		khtml_closeelem(&req.html, 1); /* h1 */
-	} else {
-		khtml_attr(&req.html, KELEM_A,
-			KATTR_HREF, "index.html", KATTR__MAX);
-		khtml_puts(&req.html, "Dashboard");
-		khtml_closeelem(&req.html, 1); /* a */
-		khtml_ncr(&req.html, 0x203a);
-		khtml_elem(&req.html, KELEM_SPAN);
-		t = kpd->parsed.i;
-		gmtime_r(&t, &tm);
-		strftime(datebuf, sizeof(datebuf), "%F", &tm);
-		khtml_puts(&req.html, datebuf);
-		khtml_closeelem(&req.html, 1); /* span */
-		khtml_closeelem(&req.html, 1); /* h1 */
+	fflush(stdout);
+	if (dup2(stdfd, STDOUT_FILENO) == -1)
+		err(EXIT_FAILURE, "dup2");
+	close(stdfd);
+
+	if (er != KCGI_OK) {
+		warnx("%s: khttp_parse: %s", name, kcgi_strerror(er));
+		goto out;
 	}
 
-	khtml_closeelem(&req.html, 1); /* h1 */
-	khtml_closeelem(&req.html, 1); /* header */
+	/* Read back the response and rewrite it without headers. */
 
-	/* Output data. */
+	if (fstat(fd, &st) == -1) {
+		warn("%s", tmp);
+		goto out;
+	}
+	buf = kmalloc(st.st_size + 1);
+	if ((ssz = pread(fd, buf, st.st_size, 0)) == -1) {
+		warn("%s", tmp);
+		goto out;
+	}
+	buf[ssz] = '\0';
 
-	if (kpn != NULL)
-		khtml_attr(&req.html, KELEM_DIV, 
-			KATTR_CLASS, "table projtable", KATTR__MAX);
-	else if (kph != NULL)
-		khtml_attr(&req.html, KELEM_DIV, 
-			KATTR_CLASS, "table unametable", KATTR__MAX);
-	else
-		khtml_attr(&req.html, KELEM_DIV, 
-			KATTR_CLASS, "table datetable", KATTR__MAX);
-	get_html_last_header(&req.html);
+	if (strncmp(buf, "Status: 200 ", 12)) {
+		rc = 1;
+		goto out;
+	} else if ((cp = strstr(buf, "\r\n\r\n")) == NULL) {
+		warnx("%s: malformed response", name);
+		goto out;
+	}
+	cp += 4;
+	ssz -= cp - buf;
 
-	if (kpn != NULL)
-		db_report_iterate_dashname(r->arg, 
-			get_html_last_report, &req,
-			kpn->parsed.s); /* project.name */
-	else if (kph != NULL)
-		db_report_iterate_dashuname(r->arg, 
-			get_html_last_report, &req,
-			kph->parsed.s); /* report.unamehash */
-	else 
-		db_report_iterate_lastdate(r->arg, 
-			get_html_last_report, &req,
-			kpd->parsed.i, /* ctime ge */
-			kpd->parsed.i + 86400); /* ctime le */
+	if (pwrite(fd, cp, ssz, 0) != ssz ||
+	    ftruncate(fd, ssz) == -1 ||
+	    fchmod(fd, 0444) == -1) {
+		warn("%s", tmp);
+		goto out;
+	} else if (rename(tmp, path) == -1) {
+		warn("%s", path);
+		goto out;
+	}
 
-	khtml_closeelem(&req.html, 1); /* table */
-	khtml_elem(&req.html, KELEM_FOOTER);
-	khtml_attr(&req.html, KELEM_A,
-		KATTR_HREF, REPO_BASE "/minci", KATTR__MAX);
-	khtml_puts(&req.html, "minci");
-	khtml_closeelem(&req.html, 1); /* a */
-	khtml_closeelem(&req.html, 1); /* footer */
-	khtml_closeelem(&req.html, 1); /* body */
-	khtml_closeelem(&req.html, 1); /* html */
-	khtml_close(&req.html);
-	free(req.nhash);
+	close(fd);
+	free(buf);
+	return 1;
+out:
+	close(fd);
+	unlink(tmp);
+	free(buf);
+	return rc;
 }
 
 /*
- * List one or more records.
+ * Render the listing of the scope "name".
+ * Returns zero on failure, non-zero on success.
  */
-static void
-get(struct kreq *r, time_t mtime)
+static int
+render_scope(struct ort *db, const char *name)
 {
+	const char	*query = NULL;
+
+	if (strcmp(name, "index") == 0)
+		query = "";
+	else if (strncmp(name, "project/", 8) == 0) {
+		if (!render_name(name + 8)) {
+			warnx("%s: not rendered", name);
+			return 1;
+		}
+		urlbuf.sz = 0;
+		url_encode(&urlbuf, name + 8);
+		query = arena_printf("%s=%.*s",
+			valid_keys[VALID_PROJECT_NAME].name, 
+			(int)urlbuf.sz, urlbuf.buf);
+	} else if (strncmp(name, "machine/", 8) == 0)
+		query = arena_printf("%s=%s",
+			valid_keys[VALID_REPORT_MACHINEID].name, 
+			name + 8);
+	else if (strncmp(name, "date/", 5) == 0)
+		query = arena_printf("%s=%s",
+			valid_keys[VALID_REPORT_CTIME].name, 
+			name + 5);
+
+	if (query == NULL) {
+		warnx("%s: unknown scope", name);
+		return 1;
+	}
 
-	if (r->fieldmap[VALID_REPORT_ID] != NULL)
-		get_single(r, mtime);
-	else if (r->fieldmap[VALID_PROJECT_NAME] != NULL)
-		get_last(r, mtime);
-	else if (r->fieldmap[VALID_REPORT_UNAMEHASH] != NULL)
-		get_last(r, mtime);
-	else if (r->fieldmap[VALID_REPORT_CTIME] != NULL)
-		get_last(r, mtime);
-	else
-		get_dash(r, mtime);
+	return render_page(db, name, query);
 }
 
 /*
- * Process a record submission.
- * Records are signed into a non-ORT field "signature".
- * This performs all sanity checks: failure is sequentially consistent,
- * timestamps are increasing, etc.
- * It outputs only HTTP 403 (error) and 201 (success).
+ * Render the pages of reports newer than "lastid" and the listings
+ * containing them, which are those whose scopes have changed.
+ * Report identifiers are sequential, so the new ones are those up to
+ * the dashboard's newest; any gaps are skipped by render_page().
+ * Returns the newest report rendered, "lastid" if there are none, or
+ * -1 on failure.
  */
-static void
-post(struct kreq *r)
+static int64_t
+render(struct ort *db, int64_t lastid)
 {
-	struct project	*proj = NULL;
-	struct user	*user = NULL;
-	struct kpair	*kps, *kpe, *kpd, *kpb, *kpt,
-			*kpi, *kpc, *kpn, *kpl, *sig,
-			*kpu, *kpum, *kpun, *kpur, *kpus,
-			*kpuv, *kpf;
-	size_t		 i, sz;
-	MD5_CTX		 ctx;
-	char		*buf = NULL;
-	char		 digest[MD5_DIGEST_STRING_LENGTH],
-			 unamedigest[MD5_DIGEST_STRING_LENGTH],
-			 projunamedigest[MD5_DIGEST_STRING_LENGTH],
-			 logdigest[MD5_DIGEST_STRING_LENGTH];
+	struct scope_q	*sq;
+	struct scope	*sc;
+	int64_t		 id, max = lastid;
+	char		 name[64], query[64];
+	int		 rc = 1;
+
+	if ((sq = db_scope_list_changed(db, lastid)) == NULL)
+		return -1;
+
+	TAILQ_FOREACH(sc, sq, _entries)
+		if (sc->lastid > max)
+			max = sc->lastid;
+
+	/* Reports first, so listings never link to missing pages. */
+
+	for (id = lastid + 1; rc && id <= max; id++) {
+		snprintf(name, sizeof(name), "report/%" PRId64, id);
+		snprintf(query, sizeof(query), "%s=%" PRId64,
+			valid_keys[VALID_REPORT_ID].name, id);
+		rc = render_page(db, name, query);
+	}
 
-	/* 
-	 * Check our non-ORT signature field was given.
-	 * It must be a 32-byte string.
-	 */
+	TAILQ_FOREACH(sc, sq, _entries)
+		if (rc)
+			rc = render_scope(db, sc->name);
+
+	db_scope_freeq(sq);
+	return rc ? max : -1;
+}
 
-	for (sig = NULL, i = 0; i < r->fieldsz; i++)
-		if (strcmp(r->fields[i].key, "signature") == 0 &&
-		    kvalid_stringne(&r->fields[i]) &&
-		    r->fields[i].valsz == 32) {
-			sig = &r->fields[i];
+/*
+ * Run as minci-render, which renders pages into STATICDIR to be served
+ * without the CGI program.
+ * The newest report rendered is kept in a file of STATICDIR, which is
+ * also locked so that only one renders at a time.
+ * With -a, all pages are rendered; with -w, it keeps rendering new
+ * reports every so many seconds.
+ */
+static int
+main_render(int argc, char *argv[])
+{
+	struct ort	*db;
+	const char	*er;
+	char		 buf[32];
+	unsigned int	 wait = 0;
+	int64_t		 lastid = -1, id;
+	ssize_t		 ssz;
+	int		 c, fd, len, rc = EXIT_FAILURE;
+
+	while ((c = getopt(argc, argv, "aw:")) != -1)
+		switch (c) {
+		case 'a':
+			lastid = 0;
+			break;
+		case 'w':
+			wait = strtonum(optarg, 0, 86400, &er);
+			if (er != NULL)
+				errx(EXIT_FAILURE, "-w: %s", er);
 			break;
+		default:
+			goto usage;
 		}
 
-	/* Check our ORT fields were given. */
-
-	if (sig == NULL ||
-	    (kpn = r->fieldmap[VALID_PROJECT_NAME]) == NULL ||
-	    (kpd = r->fieldmap[VALID_REPORT_DEPEND]) == NULL ||
-	    (kpc = r->fieldmap[VALID_REPORT_DISTCHECK]) == NULL ||
-	    (kpe = r->fieldmap[VALID_REPORT_ENV]) == NULL ||
-	    (kpf = r->fieldmap[VALID_REPORT_FETCHHEAD]) == NULL ||
-	    (kpi = r->fieldmap[VALID_REPORT_INSTALL]) == NULL ||
-	    (kpl = r->fieldmap[VALID_REPORT_LOG]) == NULL ||
-	    (kps = r->fieldmap[VALID_REPORT_START]) == NULL ||
-	    (kpb = r->fieldmap[VALID_REPORT_BUILD]) == NULL ||
-	    (kpt = r->fieldmap[VALID_REPORT_TEST]) == NULL ||
-	    (kpum = r->fieldmap[VALID_REPORT_UNAMEM]) == NULL ||
-	    (kpun = r->fieldmap[VALID_REPORT_UNAMEN]) == NULL ||
-	    (kpur = r->fieldmap[VALID_REPORT_UNAMER]) == NULL ||
-	    (kpus = r->fieldmap[VALID_REPORT_UNAMES]) == NULL ||
-	    (kpuv = r->fieldmap[VALID_REPORT_UNAMEV]) == NULL ||
-	    (kpu = r->fieldmap[VALID_USER_APIKEY]) == NULL) {
-		kutil_warnx(r, NULL, "invalid request");
-		http_open(r, KHTTP_403, KMIME__MAX, 0);
-		goto out;
-	}
+	argc -= optind;
+	if (argc != 0)
+		goto usage;
 
-	/* 
-	 * Check that if stages fail, subsequent must also fail. 
-	 * Also, the log should only be specified on failure.
-	 */
+	/* Only one renderer at a time: the others just exit. */
 
-	if ((kpe->parsed.i == 0 &&
-	     (kpd->parsed.i != 0 ||
-	      kpb->parsed.i != 0 ||
-	      kpt->parsed.i != 0 ||
-	      kpi->parsed.i != 0 ||
-	      kpc->parsed.i != 0)) ||
-	    (kpd->parsed.i == 0 &&
-	     (kpb->parsed.i != 0 ||
-	      kpt->parsed.i != 0 ||
-	      kpi->parsed.i != 0 ||
-	      kpc->parsed.i != 0)) ||
-	    (kpb->parsed.i == 0 &&
-	     (kpt->parsed.i != 0 ||
-	      kpi->parsed.i != 0 ||
-	      kpc->parsed.i != 0)) ||
-	    (kpt->parsed.i == 0 &&
-	     (kpi->parsed.i != 0 ||
-	      kpc->parsed.i != 0)) ||
-	    (kpi->parsed.i == 0 &&
-	     (kpc->parsed.i != 0)) ||
-	    (kpc->parsed.i != 0 && kpl->valsz)) {
-		kutil_warnx(r, NULL, "invalid stages");
-		http_open(r, KHTTP_403, KMIME__MAX, 0);
-		goto out;
+	if ((fd = open(STATICDIR "/.rendered", 
+	    O_RDWR | O_CREAT, 0600)) == -1)
+		err(EXIT_FAILURE, STATICDIR "/.rendered");
+	if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+		if (errno == EWOULDBLOCK)
+			return EXIT_SUCCESS;
+		err(EXIT_FAILURE, STATICDIR "/.rendered");
+	}
+
+	if (lastid == -1) {
+		if ((ssz = pread(fd, buf, sizeof(buf) - 1, 0)) == -1)
+			err(EXIT_FAILURE, STATICDIR "/.rendered");
+		buf[ssz] = '\0';
+		lastid = strtonum(buf, 0, INT64_MAX, &er);
+		if (er != NULL)
+			lastid = 0;
 	}
 
+	if ((db = db_open_logging
+	    (DATADIR "/minci.db", NULL, warnx, NULL)) == NULL)
+		errx(EXIT_FAILURE, "db_open: %s", DATADIR "/minci.db");
+
+	/* Rendering is a GET of the CGI program's usual pages. */
+
+	if (setenv("REQUEST_METHOD", "GET", 1) == -1 ||
+	    setenv("SCRIPT_NAME", CGIURL, 1) == -1 ||
+	    setenv("PATH_INFO", "/index.html", 1) == -1)
+		err(EXIT_FAILURE, "setenv");
+	unsetenv("HTTP_ACCEPT_ENCODING");
+	rendering = 1;
+
 	/* 
-	 * Check that times must increase.
-	 * FIXME: the minci.sh script uses `date +%s` to create
-	 * timestamps, which of course aren't guaranteed to increase
-	 * (though it's unlikely they won't).
+	 * Writing and renaming pages, whose request is parsed by kcgi
+	 * in a child process.
 	 */
 
-	if ((kpe->parsed.i != 0 && kpe->parsed.i < kps->parsed.i) ||
-	    (kpd->parsed.i != 0 && kpd->parsed.i < kpe->parsed.i) ||
-	    (kpb->parsed.i != 0 && kpb->parsed.i < kpd->parsed.i) ||
-	    (kpt->parsed.i != 0 && kpt->parsed.i < kpb->parsed.i) ||
-	    (kpi->parsed.i != 0 && kpi->parsed.i < kpt->parsed.i) ||
-	    (kpc->parsed.i != 0 && kpc->parsed.i < kpi->parsed.i)) {
-		kutil_warnx(r, NULL, "invalid timestamp sequence");
-		http_open(r, KHTTP_403, KMIME__MAX, 0);
+	if (pledge("stdio rpath wpath cpath fattr proc", NULL) == -1) {
+		warn("pledge");
 		goto out;
 	}
 
-	/* Hash log digest (may be zero-length). */
+	db_role(db, ROLE_consumer);
+
+	for (;;) {
+		if ((id = render(db, lastid)) == -1)
+			goto out;
+		if (id > lastid) {
+			lastid = id;
+			len = snprintf(buf, sizeof(buf), 
+				"%" PRId64 "\n", lastid);
+			if (pwrite(fd, buf, len, 0) != len ||
+			    ftruncate(fd, len) == -1)
+				warn(STATICDIR "/.rendered");
+		}
+		if (wait == 0)
+			break;
+		sleep(wait);
+	}
 
-	MD5Init(&ctx);
-	MD5Update(&ctx, kpl->parsed.s, kpl->valsz);
-	MD5End(&ctx, logdigest);
+	rc = EXIT_SUCCESS;
+out:
+	db_close(db);
+	close(fd);
+	return rc;
+usage:
+	fprintf(stderr, "usage: %s [-a] [-w seconds]\n", 
+		getprogname());
+	return EXIT_FAILURE;
+}
 
-	/* Get the project and user. */
+/*
+ * Run as a long-lived FastCGI worker, usually one of a pool managed by
+ * kfcgi(8).
+ * Roles can't be switched back once set, so keep one database
+ * connection per role open across all requests.
+ */
+static int
+main_fcgi(void)
+{
+	struct kreq	 r;
+	struct kfcgi	*fcgi;
+	struct ort	*prod = NULL, *cons = NULL;
+	enum kcgi_err	 er;
+	int		 rc = EXIT_FAILURE;
 
-	proj = db_project_get_byname(r->arg,
-		kpn->parsed.s); /* name */
-	if (proj == NULL) {
-		kutil_warnx(r, NULL, "invalid project");
-		http_open(r, KHTTP_403, KMIME__MAX, 0);
-		goto out;
+	er = khttp_fcgi_init(&fcgi, valid_keys,
+		VALID__MAX, pages, PAGE__MAX, PAGE_INDEX);
+
+	if (er != KCGI_OK) {
+		kutil_warnx(NULL, NULL, 
+			"khttp_fcgi_init: %s", kcgi_strerror(er));
+		return EXIT_FAILURE;
 	}
 
-	user = db_user_get_bykey(r->arg,
-		kpu->parsed.i); /* apikey */
-	if (user == NULL) {
-		kutil_warnx(r, NULL, "invalid user");
-		http_open(r, KHTTP_403, KMIME__MAX, 0);
+	if ((prod = db_open_logging
+	    (DATADIR "/minci.db", NULL, warnx, NULL)) == NULL ||
+	    (cons = db_open_logging
+	    (DATADIR "/minci.db", NULL, warnx, NULL)) == NULL) {
+		kutil_warnx(NULL, NULL, "db_open: %s", 
+			DATADIR "/minci.db");
 		goto out;
 	}
 
+	db_role(prod, ROLE_producer);
+	db_role(cons, ROLE_consumer);
+
 	/* 
-	 * Re-create the signature with the user's secret key.
-	 * This authenticates the message.
+	 * We need to evict the response cache or spool on posts, and
+	 * lock latency histograms (see timing_open()).
 	 */
 
-	sz = (size_t)kasprintf(&buf,
-		"project-name=%s&"
-		"report-build=%" PRId64 "&"
-		"report-distcheck=%" PRId64 "&"
-		"report-env=%" PRId64 "&"
-		"report-fetchhead=%s&"
-		"report-depend=%" PRId64 "&"
-		"report-install=%" PRId64 "&"
-		"report-log=%s&"
-		"report-start=%" PRId64 "&"
-		"report-test=%" PRId64 "&"
-		"report-unamem=%s&"
-		"report-unamen=%s&"
-		"report-unamer=%s&"
-		"report-unames=%s&"
-		"report-unamev=%s&"
-		"user-apisecret=%s",
-		proj->name,
-		kpb->parsed.i,
-		kpc->parsed.i,
-		kpe->parsed.i,
-		kpf->parsed.s,
-		kpd->parsed.i,
-		kpi->parsed.i,
-		logdigest,
-		kps->parsed.i,
-		kpt->parsed.i,
-		kpum->parsed.s,
-		kpun->parsed.s,
-		kpur->parsed.s,
-		kpus->parsed.s,
-		kpuv->parsed.s,
-		user->apisecret);
-	MD5Init(&ctx);
-	MD5Update(&ctx, buf, sz);
-	MD5End(&ctx, digest);
-	free(buf);
-	buf = NULL;
-
-	if (strcasecmp(digest, sig->parsed.s)) {
-		kutil_warnx(r, NULL, "bad signature");
-		http_open(r, KHTTP_403, KMIME__MAX, 0);
+	if (pledge("stdio rpath wpath cpath flock recvfd", NULL) == -1) {
+		kutil_warn(NULL, NULL, "pledge");
 		goto out;
 	}
 
-	/* 
-	 * Lastly, hash the uname and project.
-	 * This is a tiny database optimisation so that our dashboard
-	 * grouping (holding unames and project id steady, get maximum
-	 * ctime) is a bit easier to manage.
-	 */
+	for (;;) {
+		if ((er = khttp_fcgi_parse(fcgi, &r)) != KCGI_OK) {
+			if (er != KCGI_EXIT)
+				kutil_warnx(NULL, NULL, "khttp_fcgi_parse: "
+					"%s", kcgi_strerror(er));
+			khttp_free(&r);
+			break;
+		}
 
-	sz = (size_t)kasprintf(&buf, 
-		"%" PRId64 "|%s|%s|%s|%s|%s",
-		proj->id, kpum->parsed.s, 
-		kpun->parsed.s, kpur->parsed.s, 
-		kpus->parsed.s, kpuv->parsed.s);
-	MD5Init(&ctx);
-	MD5Update(&ctx, buf, sz);
-	MD5End(&ctx, projunamedigest);
-	free(buf);
+		/* Don't count the wait for the request as parsing. */
 
-	sz = (size_t)kasprintf(&buf, "%s|%s|%s|%s|%s",
-		kpum->parsed.s, kpun->parsed.s, kpur->parsed.s, 
-		kpus->parsed.s, kpuv->parsed.s);
-	MD5Init(&ctx);
-	MD5Update(&ctx, buf, sz);
-	MD5End(&ctx, unamedigest);
-
-	/* Insert the record. */
-
-	db_report_insert(r->arg,
-		proj->id, /* projectid */
-		user->id, /* userid */
-		kps->parsed.i, /* start */
-		kpe->parsed.i, /* env */
-		kpd->parsed.i, /* depend */
-		kpb->parsed.i, /* build */
-		kpt->parsed.i, /* test */
-		kpi->parsed.i, /* install */
-		kpc->parsed.i, /* distcheck */
-		time(NULL), /* ctime */
-		kpl == NULL ? "" : kpl->parsed.s, /* log */
-		kpum->parsed.s, /* unamem */
-		kpun->parsed.s, /* unamen */
-		kpur->parsed.s, /* unamer */
-		kpus->parsed.s, /* unames */
-		kpuv->parsed.s, /* unamev */
-		unamedigest, /* unamehash */
-		projunamedigest, /* projunamehash */
-		kpf->parsed.s); /* fetchhead */
-
-	kutil_info(r, user->email, "log submitted: %s", proj->name);
-	http_open(r, KHTTP_201, KMIME__MAX, 0);
+		timing_begin();
+		timing_open(&r);
+		if (preamble(&r))
+			dispatch(&r, r.method == KMETHOD_POST ?
+				prod : cons);
+		timing_end(&r);
+		khttp_free(&r);
+	}
+
+	rc = EXIT_SUCCESS;
 out:
-	db_project_free(proj);
-	db_user_free(user);
-	free(buf);
+	if (cons != NULL)
+		db_close(cons);
+	if (prod != NULL)
+		db_close(prod);
+	khttp_fcgi_free(fcgi);
+	return rc;
 }
 
 int
-main(void)
+main(int argc, char *argv[])
 {
 	struct kreq	 r;
+	struct cache	 c;
 	enum kcgi_err	 er;
-	struct stat	 st;
-	struct tm	 tm;
-	char		*cp;
-	time_t		 t;
+	int		 rc, fill = 0;
+	char		 key[MD5_DIGEST_STRING_LENGTH], prom[64];
+
+	/* The same program renders static pages by that name. */
+
+	if (strcmp(getprogname(), "minci-render") == 0)
+		return main_render(argc, argv);
+
+	if (khttp_fcgi_test())
+		return main_fcgi();
 
 	/* Basic checks: parse and valid page. */
 
+	timing_begin();
+	timing_phase(PHASE_PARSE);
 	er = khttp_parse(&r, valid_keys,
 		VALID__MAX, pages, PAGE__MAX, PAGE_INDEX);
+	timing_phase(PHASE__MAX);
 
 	if (er != KCGI_OK)
 		kutil_errx(&r, NULL, 
 			"khttp_parse: %s", kcgi_strerror(er));
 
-	if (r.page == PAGE__MAX) {
-		http_open(&r, KHTTP_404, KMIME__MAX, 0);
+	timing_open(&r);
+	if (!preamble(&r)) {
+		timing_end(&r);
 		khttp_free(&r);
 		return EXIT_SUCCESS;
 	}
 
-	/*
-	 * Get the last modified time of the database because we'll use
-	 * this to cache responses on the client side: if the db has
-	 * been updated, this time will jump.
-	 * Do this *before* opening the database to be conservative:
-	 * better to have extra 200s than erroneous 304s.
+	/* 
+	 * Send a cached response, if any, without touching the
+	 * database; otherwise, render into the cache once the database
+	 * is known to be good.
 	 */
 
-	if (stat(DATADIR "/minci.db", &st) == -1) {
-		kutil_err(&r, NULL, DATADIR "/minci.db");
+	if ((rc = cache_key(&r, key)) && cache_send(key)) {
+		timing_end(&r);
 		khttp_free(&r);
-		return EXIT_FAILURE;
-	}
-
-	if (r.method == KMETHOD_GET &&
-	    r.reqmap[KREQU_IF_MODIFIED_SINCE] != NULL) {
-		memset(&tm, 0, sizeof(struct tm));
-		cp = strptime
-			(r.reqmap[KREQU_IF_MODIFIED_SINCE]->val,
-			 "%a, %d %b %Y %T GMT", &tm);
-		if (cp != NULL && 
-		    (t = mktime(&tm)) != -1 &&
-		    st.st_mtime <= t) {
-			http_open(&r, KHTTP_304, r.mime, 0);
-			khttp_free(&r);
-			return EXIT_SUCCESS;
-		}
+		return EXIT_SUCCESS;
 	}
 
 	/* Open the database. */
 
+	timing_phase(PHASE_OPEN);
 	if ((r.arg = db_open_logging
 	    (DATADIR "/minci.db", NULL, warnx, NULL)) == NULL) {
 		kutil_errx(&r, NULL, "db_open: %s", 
@@ -1233,25 +4079,43 @@ main(void)
 		khttp_free(&r);
 		return EXIT_FAILURE;
 	}
+	timing_phase(PHASE__MAX);
+
+	if (rc)
+		fill = cache_fill_open(&c, key);
+	timing.nohead = fill;
 
-	if (pledge("stdio", NULL) == -1) {
+	/* 
+	 * Filling the cache needs to rename(2) the response into
+	 * place; posting needs to evict the cache or write the spool;
+	 * the latency histogram, if open, needs to be locked.
+	 */
+
+	if (r.method == KMETHOD_POST)
+		strlcpy(prom, cache_enabled() || spool_enabled() ? 
+			"stdio rpath wpath cpath" : "stdio", 
+			sizeof(prom));
+	else
+		strlcpy(prom, fill ? "stdio cpath" : "stdio", 
+			sizeof(prom));
+	if (timing.fd != -1)
+		strlcat(prom, " flock", sizeof(prom));
+
+	if (pledge(prom, NULL) == -1) {
 		kutil_warn(NULL, NULL, "pledge");
 		db_close(r.arg);
 		khttp_free(&r);
 		return EXIT_FAILURE;
 	}
 
-	/* Switch on method, not resource. */
-
-	if (r.method == KMETHOD_POST) {
-		db_role(r.arg, ROLE_producer);
-		post(&r);
-	} else {
-		db_role(r.arg, ROLE_consumer);
-		get(&r, st.st_mtime);
-	}
+	db_role(r.arg, r.method == KMETHOD_POST ?
+		ROLE_producer : ROLE_consumer);
+	dispatch(&r, r.arg);
+	timing_end(&r);
 
 	db_close(r.arg);
 	khttp_free(&r);
+	if (fill)
+		cache_fill_close(&c);
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,93 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2020 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef MINCI_H
+#define MINCI_H
+
+/*
+ * Shared by the CGI program (main.c) and the spool committer
+ * (ingest.c), which both insert submissions (submit.c).
+ * Needs <md5.h>, <kcgi.h>, and "extern.h".
+ */
+
+#ifndef CACHEDIR
+#define CACHEDIR DATADIR "/cache"
+#endif
+#ifndef SPOOLDIR
+#define SPOOLDIR DATADIR "/spool"
+#endif
+
+/*
+ * Number of stages, which are numbered from zero.
+ */
+#define	STAGESZ 6
+
+/*
+ * Stages as named in "metrics-" submission fields, in the
+ * (alphabetical) order they're signed.
+ * Stage values are less than STAGESZ, so they can be used as indices.
+ */
+struct	stagename {
+	enum stage	 stage;
+	const char	*name;
+};
+
+/*
+ * A report submission, either alone or part of a batch.
+ */
+struct	submit {
+	struct kpair	*kps, *kpe, *kpd, *kpb, *kpt,
+			*kpi, *kpc, *kpn, *kpl, *sig,
+			*kpum, *kpun, *kpur, *kpus,
+			*kpuv, *kpf;
+	struct kpair	*kpm[STAGESZ]; /* optional, as in stages */
+	struct project	*proj; /* set by submit_check() */
+	char		 unamedigest[MD5_DIGEST_STRING_LENGTH];
+	char		 logdigest[MD5_DIGEST_STRING_LENGTH];
+};
+
+/*
+ * Fields of a submission written to the spool, not counting the
+ * optional metrics.
+ */
+#define	SPOOLKEYS 15
+
+/*
+ * A submission read back from the spool (see spool_read()).
+ * Its fields point into the spool file's contents.
+ */
+struct	spooled {
+	struct submit	 s; /* without signature */
+	struct kpair	 kps[SPOOLKEYS + STAGESZ];
+	int64_t		 userid; /* submitting user */
+	time_t		 ctime; /* when submitted */
+	char		*buf; /* contents of spool file */
+};
+
+extern const struct stagename stages[STAGESZ];
+
+int	 cache_enabled(void);
+void	 cache_bump(void);
+int64_t	 submit_insert(struct ort *, const struct submit *,
+		int64_t, time_t);
+int	 spool_enabled(void);
+int	 spool_write(const struct submit *, int64_t, time_t,
+		char *, size_t);
+int	 spool_commit(const char *);
+int	 spool_read(struct ort *, const char *, struct spooled *);
+void	 spool_free(struct spooled *);
+
+#endif /*!MINCI_H*/
@@ -1,8 +1,9 @@
 #! /bin/sh
 
 # Usage:
-# minci.sh [-fnrv] [repo...]
+# minci.sh [-fnrv] [-j jobs] [repo...]
 #  -f: force updates
+#  -j: check this many repositories at once
 #  -n: don't do anything, but show what would be done
 #  -r: run full check, but don't upload results
 #  -v: more data while running
@@ -20,6 +21,11 @@ AUTOUP=1
 API_KEY=
 SERVER=
 STAGING="$HOME/.local/cache/minci"
+QUEUE="$STAGING/queue"
+HEADS="$STAGING/heads"
+JOBS=1
+NJOBS=0
+PIDS=
 CONFIG=
 CONFIG_LOCAL="$HOME/.minci"
 CONFIG_GLOBAL="/etc/minci"
@@ -42,6 +48,8 @@ debug()
 	[ -z "${VERBOSE}" ] || echo "$PROGNAME: $(date +"%F %T"): $@"
 }
 
+# Run $1 for repository $2 as part of stage $3, logging to fd-3.
+# If time(1) can, record its resource usage (see metrics).
 run()
 {
 	debug "$1: $2"
@@ -49,12 +57,180 @@ run()
 	then
 		echo "$PROGNAME: $1: $2" 1>&3
 		set +e ; 
-		eval "$1" 1>&3 2>&3 || { set -e ; return 1; }
+		if [ -n "$TIMEFMT" ]
+		then
+			runtimed "$1" "$3" || { set -e ; return 1; }
+		else
+			eval "$1" 1>&3 2>&3 || { set -e ; return 1; }
+		fi
 		set -e ;
 	fi
 	return 0
 }
 
+# Run $1 under time(1), appending its output to the repository's log
+# (which fd-3 also appends to) and recording its resource usage as
+# stage $2 in the repository's metrics file.
+# Usage is a line of the stage, wall, user, and system milliseconds,
+# peak resident kilobytes, and blocks in and out.
+runtimed()
+{
+	tf="$QUEUE/$reponame.time"
+	if [ "$TIMEFMT" = "gnu" ]
+	then
+		/usr/bin/time -f "%e %U %S %M %I %O" \
+			sh -c 'eval "$1" >>"$2" 2>&1' sh \
+			"$1" "$QUEUE/$reponame.log" 2>"$tf"
+	else
+		/usr/bin/time -l \
+			sh -c 'eval "$1" >>"$2" 2>&1' sh \
+			"$1" "$QUEUE/$reponame.log" 2>"$tf"
+	fi
+	rc=$?
+	if [ "$TIMEFMT" = "gnu" ]
+	then
+		tail -1 "$tf" | awk -v s="$2" '{ printf("%s %.0f %.0f " \
+			"%.0f %.0f %.0f %.0f\n", s, $1 * 1000, $2 * 1000, \
+			$3 * 1000, $4, $5, $6) }'
+	else
+		awk -v s="$2" -v d="$TIMERSS" '
+			/ real / { w = $1; u = $3; y = $5 }
+			/maximum resident set size/ { r = $1 }
+			/block input operations/ { i = $1 }
+			/block output operations/ { o = $1 }
+			END { printf("%s %.0f %.0f %.0f %.0f %.0f %.0f\n",
+				s, w * 1000, u * 1000, y * 1000, 
+				r / d, i, o) }' "$tf"
+	fi >> "$QUEUE/$reponame.metrics"
+	rm -f "$tf"
+	return $rc
+}
+
+# Print the resource usage of each stage of the repository, summed
+# over its commands, with the greatest peak resident size, as a line of
+# the stage and its comma-separated usage, ordered by stage name.
+metrics()
+{
+	[ -r "$QUEUE/$reponame.metrics" ] || return 0
+	for stage in build depend distcheck env install test
+	do
+		awk -v s=$stage '$1 == s { 
+			w += $2; u += $3; y += $4; i += $6; o += $7; n++
+			if ($5 > r) 
+				r = $5 
+		} 
+		END { if (n) printf("%s %.0f,%.0f,%.0f,%.0f,%.0f,%.0f\n",
+			s, w, u, y, r, i, o) }' "$QUEUE/$reponame.metrics"
+	done
+}
+
+# Queue form field $1 with value $2 for the current report.
+# The field name is suffixed by "@@", which is replaced when sending
+# (see send_queue).
+queue()
+{
+	printf 'form = "%s@@=%s"\n' "$1" \
+		"$(printf '%s' "$2" | sed 's![\\"]!\\&!g')" \
+		>> "$QUEUE/$reponame.curl"
+}
+
+# Forget the queued reports of repositories $@ once sent, recording the
+# head each tested for the next run's freshness check (see runrepo).
+sent()
+{
+	for name in "$@"
+	do
+		[ ! -r "$QUEUE/$name.head" ] || \
+			mv -f "$QUEUE/$name.head" "$HEADS/$name"
+		rm -f "$QUEUE/$name.curl" "$QUEUE/$name.log" \
+			"$QUEUE/$name.metrics"
+	done
+}
+
+# Forget the reports of repositories $2... sent as a batch whose response
+# is in file $1, each only if the server accepted it (see sent).
+sent_batch()
+{
+	reply="$1"
+	shift
+	grep -o '"ok": *[a-z]*' "$reply" | sed 's!.*: *!!' |
+	for name in "$@"
+	do
+		read -r ok || ok=false
+		if [ "$ok" = "true" ]
+		then
+			sent "$name"
+		else
+			msg "report not accepted: $name"
+		fi
+	done
+}
+
+# Send all queued reports: alone if there's only one, otherwise as
+# batches of at most 64 (the server's limit) with the fields numbered by
+# report.
+# Reports that can't be sent or aren't accepted are left queued, without
+# their heads being recorded, so the repositories are run again next
+# time.
+send_queue()
+{
+	set -- "$QUEUE"/*.curl
+	[ -r "$1" ] || return 0
+	debug "sending reports: $#"
+	if [ $# -eq 1 ]
+	then
+		sed 's!^\(form = "[a-z-]*\)@@=!\1=!' \
+			"$1" > "$QUEUE/send"
+		echo "form = \"user-apikey=${API_KEY}\"" >> "$QUEUE/send"
+		name="${1##*/}"
+		shift
+		if curl -fsS -K "$QUEUE/send" "${SERVER}"
+		then
+			sent "${name%.curl}"
+		else
+			msg "could not send report: ${name%.curl}"
+		fi
+	fi
+	while [ $# -gt 0 ]
+	do
+		: > "$QUEUE/send"
+		i=0
+		names=
+		while [ $# -gt 0 -a $i -lt 64 ]
+		do
+			sed "s!^\\(form = \"[a-z-]*\\)@@=!\\1.$i=!" \
+				"$1" >> "$QUEUE/send"
+			name="${1##*/}"
+			names="$names ${name%.curl}"
+			i=$(( $i + 1 ))
+			shift
+		done
+		echo "form = \"user-apikey=${API_KEY}\"" >> "$QUEUE/send"
+		if curl -fsS -K "$QUEUE/send" "${SERVER}/batch" \
+		    > "$QUEUE/reply"
+		then
+			cat "$QUEUE/reply"
+			sent_batch "$QUEUE/reply" $names
+		else
+			msg "could not send reports:$names"
+		fi
+	done
+	rm -f "$QUEUE/send" "$QUEUE/reply"
+}
+
+# Wait for the oldest running job (see runrepo), then show its output.
+reap()
+{
+	set -- $PIDS
+	job="$1"
+	shift
+	PIDS="$*"
+	NJOBS=$(( $NJOBS - 1 ))
+	wait "${job%%:*}" && NPROC=$(( $NPROC + 1 ))
+	cat "$QUEUE/${job#*:}.out"
+	rm -f "$QUEUE/${job#*:}.out"
+}
+
 # Run $1, exiting on failure.
 runnolog()
 {
@@ -65,10 +241,10 @@ runnolog()
 	fi
 }
 
-args=$(getopt fnrv $*)
+args=$(getopt fj:nrv $*)
 if [ $? -ne 0 ]
 then
-	echo "usage: $PROGNAME [-fnrv] [repo ...]" 1>&2
+	echo "usage: $PROGNAME [-fnrv] [-j jobs] [repo ...]" 1>&2
 	exit 1
 fi
 
@@ -84,6 +260,8 @@ do
 			NOREP=1 ; shift ;;
 		-f)
 			FORCE=1 ; shift ;;
+		-j)
+			JOBS="$2" ; shift ; shift ;;
 		-v)
 			VERBOSE=1 ; shift ;;
 		--)
@@ -91,6 +269,16 @@ do
         esac
 done
 
+case "$JOBS" in
+	''|*[!0-9]*|0)
+		fatal "-j: positive number expected: $JOBS" ;;
+esac
+
+# Nothing is written when not doing anything, so there's nowhere to
+# keep the output of parallel jobs.
+
+[ -z "$NOOP" ] || JOBS=1
+
 # Start with the local then global configuration.
 # Require at least one of them.
 
@@ -160,6 +348,21 @@ debug "using API key: $API_KEY"
 debug "using API secret: $API_SECRET"
 debug "using server: $SERVER"
 
+# Find how to get resource usage from time(1), if at all: BSD's -l,
+# which gives resident size in bytes on Mac OS X, or GNU's -f.
+
+TIMEFMT=
+TIMERSS=1
+if /usr/bin/time -l true >/dev/null 2>&1
+then
+	TIMEFMT="bsd"
+	[ "$(uname -s)" != "Darwin" ] || TIMERSS=1024
+elif /usr/bin/time -f "%e" true >/dev/null 2>&1
+then
+	TIMEFMT="gnu"
+fi
+debug "using time(1) format: ${TIMEFMT:-none}"
+
 for dep in $DEP_BINS
 do
 	debug "check binary dependency: $dep"
@@ -182,6 +385,16 @@ then
  	debug "created: $STAGING"
 fi
 
+# Clear out reports left queued by an interrupted run.
+
+if [ -z "$NOOP" ]
+then
+	mkdir -p "$QUEUE" || fatal "could not create: $QUEUE"
+	mkdir -p "$HEADS" || fatal "could not create: $HEADS"
+	rm -f "$QUEUE"/*.curl "$QUEUE"/*.log "$QUEUE"/*.out \
+		"$QUEUE"/*.metrics "$QUEUE"/*.head
+fi
+
 # Auto-update feature.
 # FIXME: NOT FOR PERMANENT USE.
 # This will eventually be replaced by a real package manager, but for
@@ -190,21 +403,28 @@ fi
 
 if [ -n "$AUTOUP" ]
 then
-	# Same way as we'll use for repositories later on.
+	# Same way as we'll use for repositories later on: first
+	# check the remote head against the installed one.
 
 	debug "checking auto-up status"
 	set -e
 	FETCH_HEAD=""
 	head=""
+	remote=""
+
+	if [ -z "$NOOP" ]
+	then
+		[ ! -r "$STAGING/minci.installed" ] || head="$(cat "$STAGING/minci.installed")"
+		remote="$(git ls-remote "$MINCI_REPO" refs/heads/master 2>/dev/null | cut -f1)"
+	fi
 
 	[ -n "$NOOP" ] || cd "$STAGING"
-	if [ -d "minci" ]
+	if [ -n "$head" ] && [ "$head" = "$remote" ]
 	then
-		if [ -z "$NOOP" ]
-		then
-			cd "minci"
-			head="$(cut -f1 .git/FETCH_HEAD 2>/dev/null | head -1)"
-		fi
+		FETCH_HEAD="$head"
+	elif [ -d "minci" ]
+	then
+		[ -n "$NOOP" ] || cd "minci"
 		runnolog "git fetch origin"
 		runnolog "git reset --hard origin/master"
 		runnolog "git clean -fdx"
@@ -213,7 +433,7 @@ then
 			FETCH_HEAD="$(cut -f1 .git/FETCH_HEAD | head -1)"
 		fi
 	else
-		runnolog "git clone $MINCI_REPO"
+		runnolog "git clone --filter=blob:none $MINCI_REPO"
 		if [ -z "$NOOP" ]
 		then
 			cd "minci"
@@ -243,6 +463,7 @@ then
 		if [ -z "$NOOP" ]
 		then
 			runnolog "install -m 0755 minci.sh $HOME/bin"
+			echo "$FETCH_HEAD" > "$STAGING/minci.installed"
 		fi
 		msg "updated binary: now at commit $FETCH_HEAD"
 		exit 0
@@ -251,47 +472,45 @@ then
 	set +e
 fi
 
-# Process each repository line.
+# Check, build, and queue the report of repository $1 named $2.
+# This is run in its own subshell, possibly in parallel with others, so
+# it only communicates by its standard output and by the files in
+# $QUEUE named for the repository.
+# Returns zero if the report was made, non-zero if fresh.
+runrepo()
+{
+	repo="$1"
+	reponame="$2"
 
-NPROC=0
-while read -r ln
-do
-	repo="$(echo "$ln" | sed -n 's!^[ ]*repo[ ]*=[ ]*!!p')"
-	[ -z "$repo" ] && continue
-	reponame="$(echo "$repo" | sed -e 's!.*/!!' -e 's!\.git$!!')"
-	if [ -z "$reponame" ]
-	then
-		fatal "malformed repo: $repo"
-	fi
+	# Get ready for actual processing.
+	# Now errors without || are fatal.
 
-	# Iterate through the command-line arguments, only if specified,
-	# to see if we want to run this.
+	set -e
 
-	if [ $# -gt 0 ]
+	debug "$repo: $reponame"
+
+	# If the remote head is the one we last tested, don't re-test it
+	# unless -f was passed.
+	# This asks the remote without fetching anything.
+
+	if [ -z "$NOOP" ] && [ -z "$FORCE" ] && [ -r "$HEADS/$reponame" ]
 	then
-		for prog in "$@"
-		do
-			if [ "$prog" = "$reponame" ]
-			then
-				prog=""
-				break
-			fi
-		done
-		if [ -n "$prog" ]
+		remote="$(git ls-remote "$repo" refs/heads/master 2>/dev/null | cut -f1)"
+		if [ -n "$remote" ] && [ "$remote" = "$(cat "$HEADS/$reponame")" ]
 		then
-			debug "ignoring: $reponame"
-			continue
+			debug "repository is fresh: $reponame"
+			return 1
 		fi
 	fi
 
-	# Get ready for actual processing.
-	# Now errors without || are fatal.
-
-	set -e
-
-	debug "$repo: $reponame"
+	# Commands run by runtimed also append to the log.
 
-	[ -n "$NOOP" ] || exec 3>/tmp/minci.log
+	if [ -z "$NOOP" ]
+	then
+		: > "$QUEUE/$reponame.log"
+		rm -f "$QUEUE/$reponame.metrics"
+		exec 3>>"$QUEUE/$reponame.log"
+	fi
 	[ -n "$NOOP" ] || cd "$STAGING"
 
 	# Set all of our times to zero.
@@ -318,70 +537,56 @@ do
 
 	while :
 	do
-		head=""
 		FETCH_HEAD=""
 
 		# If we have a repository already, update and clean it
-		# out; otherwise, clone it afresh.
+		# out; otherwise, clone it afresh without blobs, which
+		# are fetched as needed.
 		# Keep track of the FETCH_HEAD last commit.
 
 		if [ -d "$reponame" ]
 		then
-			if [ -z "$NOOP" ]
-			then
-				cd "$reponame"
-				head="$(cut -f1 .git/FETCH_HEAD 2>/dev/null | head -1)"
-			fi
-			run "git fetch origin" "$reponame" || break
-			run "git reset --hard origin/master" "$reponame" || break
-			run "git clean -fdx" "$reponame" || break
+			[ -n "$NOOP" ] || cd "$reponame"
+			run "git fetch origin" "$reponame" env || break
+			run "git reset --hard origin/master" "$reponame" env || break
+			run "git clean -fdx" "$reponame" env || break
 			if [ -z "$NOOP" ]
 			then
 				FETCH_HEAD="$(cut -f1 .git/FETCH_HEAD | head -1)"
 			fi
 		else
-			run "git clone $repo" "$reponame" || break
+			run "git clone --filter=blob:none $repo" "$reponame" env || break
 			if [ -z "$NOOP" ]
 			then
 				cd "$reponame"
 			fi
 			# Grabs the newest .git/FETCH_HEAD.
-			run "git fetch origin" "$reponame" || break
-			run "git reset --hard origin/master" "$reponame" || break
+			run "git fetch origin" "$reponame" env || break
+			run "git reset --hard origin/master" "$reponame" env || break
 			if [ -z "$NOOP" ]
 			then
 				FETCH_HEAD="$(cut -f1 .git/FETCH_HEAD | head -1)"
 			fi
 		fi
 
-		# If the FETCH_HEAD commit doesn't change when we freshen the
-		# repository, then doing re-test it unless -f was passed.
-
-		if [ -z "$FORCE" ] && [ -n "$head" ] && [ "$head" = "$FETCH_HEAD" ]
-		then
-			debug "repository is fresh: $reponame"
-			TIME_start=0
-			break
-		fi
-
 		TIME_env=$(date +%s)
 
 		# Run ./configure, make, make regress, make install,
 		# make distcheck.  If any fail, then break out.
 
-		run "./configure PREFIX=build" "$reponame" || break
+		run "./configure PREFIX=build" "$reponame" depend || break
 		TIME_depend=$(date +%s)
 
-		run "${MAKE}" "$reponame" || break
+		run "${MAKE}" "$reponame" build || break
 		TIME_build=$(date +%s)
 
-		run "${MAKE} regress" "$reponame" || break
+		run "${MAKE} regress" "$reponame" test || break
 		TIME_test=$(date +%s)
 
-		run "${MAKE} install" "$reponame" || break
+		run "${MAKE} install" "$reponame" install || break
 		TIME_install=$(date +%s)
 
-		run "${MAKE} distcheck" "$reponame" || break
+		run "${MAKE} distcheck" "$reponame" distcheck || break
 		TIME_distcheck=$(date +%s)
 
 		# Success!
@@ -394,13 +599,13 @@ do
 	[ -n "$NOOP" ] || exec 3>&-
 	set +e
 
-	if [ $TIME_start -eq 0 ]
+	# Keep the head we tested for the next run's freshness check.
+	# It's only recorded once the report has been sent (see sent).
+
+	if [ -z "$NOOP" -a -z "$NOREP" ] && [ -n "$FETCH_HEAD" ]
 	then
-		[ -n "$NOOP" ] || rm -f /tmp/minci.log
-		continue
+		echo "$FETCH_HEAD" > "$QUEUE/$reponame.head"
 	fi
-	
-	NPROC=$(( $NPROC + 1 ))
 
 	if [ $TIME_distcheck -eq 0 ]
 	then
@@ -422,7 +627,17 @@ do
 	# alphabetical order (by key), with the report-log (or /dev/null
 	# if there's no need to report) being replaced by its MD5 hash.
 
-	QUERY="project-name=${reponame}"
+	# Resource usage, if any, is first by key order.
+
+	QUERY=""
+	METRICS="$(metrics)"
+	if [ -n "$METRICS" ]
+	then
+		QUERY="$(echo "$METRICS" | \
+			sed 's!^\([a-z]*\) \(.*\)$!metrics-\1=\2\&!' | \
+			tr -d '\n')"
+	fi
+	QUERY="${QUERY}project-name=${reponame}"
 	QUERY="${QUERY}&report-build=${TIME_build}"
 	QUERY="${QUERY}&report-distcheck=${TIME_distcheck}"
 	QUERY="${QUERY}&report-env=${TIME_env}"
@@ -431,7 +646,7 @@ do
 	QUERY="${QUERY}&report-install=${TIME_install}"
 	if [ $TIME_distcheck -eq 0 ]
 	then
-		hashfile="/tmp/minci.log"
+		hashfile="$QUEUE/$reponame.log"
 	else
 		hashfile="/dev/null"
 	fi
@@ -452,50 +667,107 @@ do
 
 	SIGNATURE=$(printf "%s" "$QUERY" | openssl dgst -md5 -hex | sed 's!^[^=]*= !!')
 
-	# Now actually send the report.
+	# Now queue the report to be sent with any others once all
+	# repositories have run.
 	# It includes the signature and optionally the build log (only
 	# if we didn't get to the end).
 
-	debug "sending report: $SERVER"
+	if [ -z "$NOOP" -a -z "$NOREP" ]
+	then
+		debug "queueing report: $reponame"
+		if [ $TIME_distcheck -eq 0 ]
+		then
+			echo "form = \"report-log@@=<$QUEUE/$reponame.log\"" \
+				>> "$QUEUE/$reponame.curl"
+		else
+			queue "report-log" ""
+		fi
+		queue "project-name" "${reponame}"
+		queue "report-start" "${TIME_start}"
+		queue "report-env" "${TIME_env}"
+		queue "report-depend" "${TIME_depend}"
+		queue "report-build" "${TIME_build}"
+		queue "report-test" "${TIME_test}"
+		queue "report-install" "${TIME_install}"
+		queue "report-distcheck" "${TIME_distcheck}"
+		queue "report-unamem" "${UNAME_M}"
+		queue "report-unamen" "${UNAME_N}"
+		queue "report-unamer" "${UNAME_R}"
+		queue "report-unames" "${UNAME_S}"
+		queue "report-unamev" "${UNAME_V}"
+		queue "report-fetchhead" "${FETCH_HEAD}"
+		queue "signature" "${SIGNATURE}"
+		echo "$METRICS" | while read -r stage m
+		do
+			[ -z "$stage" ] || queue "metrics-$stage" "$m"
+		done
+	fi
+	if [ -z "$NOOP" ] && [ $TIME_distcheck -ne 0 -o -n "$NOREP" ]
+	then
+		rm -f "$QUEUE/$reponame.log"
+	fi
+	return 0
+}
 
-	REPORT_LOG=
-	if [ $TIME_distcheck -eq 0 ]
+# Process each repository line.
+# With -j, run that many repositories at a time, showing each one's
+# output only once it has finished.
+
+NPROC=0
+while read -r ln
+do
+	repo="$(echo "$ln" | sed -n 's!^[ ]*repo[ ]*=[ ]*!!p')"
+	[ -z "$repo" ] && continue
+	reponame="$(echo "$repo" | sed -e 's!.*/!!' -e 's!\.git$!!')"
+	if [ -z "$reponame" ]
 	then
-		REPORT_LOG="-F report-log=</tmp/minci.log"
-	else
-		REPORT_LOG="-F report-log="
+		fatal "malformed repo: $repo"
 	fi
 
-	if [ -z "$NOOP" -a -z "$NOREP" ]
+	# Iterate through the command-line arguments, only if specified,
+	# to see if we want to run this.
+
+	if [ $# -gt 0 ]
 	then
-		curl -sS ${REPORT_LOG} \
-		     -F "project-name=${reponame}" \
-		     -F "report-start=${TIME_start}" \
-		     -F "report-env=${TIME_env}" \
-		     -F "report-depend=${TIME_depend}" \
-		     -F "report-build=${TIME_build}" \
-		     -F "report-test=${TIME_test}" \
-		     -F "report-install=${TIME_install}" \
-		     -F "report-distcheck=${TIME_distcheck}" \
-		     -F "report-unamem=${UNAME_M}" \
-		     -F "report-unamen=${UNAME_N}" \
-		     -F "report-unamer=${UNAME_R}" \
-		     -F "report-unames=${UNAME_S}" \
-		     -F "report-unamev=${UNAME_V}" \
-		     -F "report-fetchhead=${FETCH_HEAD}" \
-		     -F "user-apikey=${API_KEY}" \
-		     -F "signature=${SIGNATURE}" \
-		     "${SERVER}"
+		for prog in "$@"
+		do
+			if [ "$prog" = "$reponame" ]
+			then
+				prog=""
+				break
+			fi
+		done
+		if [ -n "$prog" ]
+		then
+			debug "ignoring: $reponame"
+			continue
+		fi
 	fi
-	if [ -z "$NOOP" ]
+
+	if [ $JOBS -gt 1 ]
 	then
-		rm -f /tmp/minci.log
+		runrepo "$repo" "$reponame" \
+			</dev/null >"$QUEUE/$reponame.out" 2>&1 &
+		PIDS="$PIDS $!:$reponame"
+		NJOBS=$(( $NJOBS + 1 ))
+		[ $NJOBS -lt $JOBS ] || reap
+	else
+		# Not in an AND-OR list, which would disable set -e.
+		( runrepo "$repo" "$reponame" </dev/null )
+		[ $? -ne 0 ] || NPROC=$(( $NPROC + 1 ))
 	fi
 done < "$CONFIG"
 
+while [ $NJOBS -gt 0 ]
+do
+	reap
+done
+
 if [ $NPROC -eq 0 ]
 then
 	msg "all repositories up to date"
 fi
 
+send_queue
+
 exit 0
@@ -0,0 +1,64 @@
+#! /bin/sh
+
+# Usage:
+# queryplan.sh db.o minci.db
+# Run EXPLAIN QUERY PLAN on each query compiled into the generated
+# database layer (as found by strings(1)), failing if any of them scans
+# a table instead of searching or walking an index.
+# Tables in ALLOWSCAN are exempt: their queries always want all rows.
+
+PROGNAME="$0"
+ALLOWSCAN="${ALLOWSCAN:-projsummary}"
+
+if [ $# -ne 2 ]
+then
+	echo "usage: $PROGNAME db.o minci.db" 1>&2
+	exit 1
+fi
+
+STMTS="$(strings "$1" | grep -E '^(SELECT|UPDATE|DELETE) ' | sort -u)"
+if [ -z "$STMTS" ]
+then
+	echo "$PROGNAME: no queries found: $1" 1>&2
+	exit 1
+fi
+
+FAIL=0
+while read -r stmt
+do
+	plan="$(echo "EXPLAIN QUERY PLAN $stmt;" | sqlite3 "$2")"
+	if [ $? -ne 0 ]
+	then
+		echo "$PROGNAME: cannot plan: $stmt" 1>&2
+		FAIL=1
+		continue
+	fi
+	scans="$(echo "$plan" | 
+		grep -E 'SCAN ' | 
+		grep -vE 'USING (COVERING )?INDEX|CONSTANT ROW')"
+	# Newer SQLite names scans by the table's alias (as ORT uses)
+	# instead of the table, so exempt those aliases too.
+
+	allow=
+	for table in $ALLOWSCAN
+	do
+		allow="$allow $table $(echo "$stmt" | 
+			grep -oE "(FROM|JOIN) $table AS [_a-zA-Z0-9]+" |
+			sed 's!.* AS !!')"
+	done
+	for name in $allow
+	do
+		scans="$(echo "$scans" | 
+			grep -vE "SCAN (TABLE )?$name( |\$)")"
+	done
+	if [ -n "$scans" ]
+	then
+		echo "$PROGNAME: scan: $stmt" 1>&2
+		echo "$plan" 1>&2
+		FAIL=1
+	fi
+done <<__EOF__
+$STMTS
+__EOF__
+
+exit $FAIL
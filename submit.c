@@ -0,0 +1,961 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2020 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <assert.h>
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <md5.h>
+#include <stddef.h> /* offsetof */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <kcgi.h>
+#include <kcgijson.h> /* extern.h */
+
+#include "extern.h"
+#include "minci.h"
+
+#ifndef REGRESSX
+#define REGRESSX 2
+#endif
+#ifndef LOGZLEVEL
+#define LOGZLEVEL Z_BEST_COMPRESSION
+#endif
+
+/*
+ * Days of history for the rolling median of a stage's duration, and
+ * the fewest of those days needed to flag a regression.
+ */
+#define	ROLLDAYS 28
+#define	ROLLMIN 3
+
+/*
+ * Bytes of a log (uncompressed) in each of its chunks, which is also
+ * the granularity of its line index.
+ */
+#define	LOGCHUNK (128 * 1024)
+
+/*
+ * Lines of a failed report's log stored to be shown with the report.
+ */
+#define	LOGTAIL 16
+
+const struct stagename stages[STAGESZ] = {
+	{ STAGE_build, "build" },
+	{ STAGE_depend, "depend" },
+	{ STAGE_distcheck, "distcheck" },
+	{ STAGE_env, "env" },
+	{ STAGE_install, "install" },
+	{ STAGE_test, "test" },
+};
+
+/*
+ * Fields of a submission as written to the spool, named as submitted.
+ * Each is the offset of its pair in the submit structure and whether
+ * it's an integer.
+ */
+static const struct {
+	const char	*name;
+	size_t		 offs;
+	int		 isint;
+} spoolkeys[SPOOLKEYS] = {
+	{ "project-name", offsetof(struct submit, kpn), 0 },
+	{ "report-build", offsetof(struct submit, kpb), 1 },
+	{ "report-depend", offsetof(struct submit, kpd), 1 },
+	{ "report-distcheck", offsetof(struct submit, kpc), 1 },
+	{ "report-env", offsetof(struct submit, kpe), 1 },
+	{ "report-fetchhead", offsetof(struct submit, kpf), 0 },
+	{ "report-install", offsetof(struct submit, kpi), 1 },
+	{ "report-log", offsetof(struct submit, kpl), 0 },
+	{ "report-start", offsetof(struct submit, kps), 1 },
+	{ "report-test", offsetof(struct submit, kpt), 1 },
+	{ "report-unamem", offsetof(struct submit, kpum), 0 },
+	{ "report-unamen", offsetof(struct submit, kpun), 0 },
+	{ "report-unamer", offsetof(struct submit, kpur), 0 },
+	{ "report-unames", offsetof(struct submit, kpus), 0 },
+	{ "report-unamev", offsetof(struct submit, kpuv), 0 },
+};
+
+/*
+ * Whether rendered responses are cached: only if the cache directory
+ * has been created by the administrator.
+ */
+int
+cache_enabled(void)
+{
+
+	return access(CACHEDIR, F_OK) == 0;
+}
+
+/*
+ * Start a new cache generation after the database has changed and
+ * evict all cached responses.
+ * The generation is random so that concurrent bumps can't collide.
+ * Responses rendered from the old generation, yet finishing after the
+ * eviction, are keyed by the old generation and evicted next time.
+ */
+void
+cache_bump(void)
+{
+	DIR		*dir;
+	struct dirent	*dp;
+	char		 tmp[PATH_MAX], path[PATH_MAX];
+	uint64_t	 gen;
+	int		 fd, len;
+	char		 buf[32];
+
+	if (!cache_enabled())
+		return;
+
+	arc4random_buf(&gen, sizeof(gen));
+	len = snprintf(buf, sizeof(buf), "%016" PRIx64, gen);
+	strlcpy(tmp, CACHEDIR "/tmp.XXXXXXXXXX", sizeof(tmp));
+
+	if ((fd = mkstemp(tmp)) == -1) {
+		warn("%s", tmp);
+		return;
+	} else if (write(fd, buf, len) != len) {
+		warn("%s", tmp);
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+	close(fd);
+
+	if (rename(tmp, CACHEDIR "/generation") == -1) {
+		warn(CACHEDIR "/generation");
+		unlink(tmp);
+		return;
+	}
+
+	if ((dir = opendir(CACHEDIR)) == NULL) {
+		warn(CACHEDIR);
+		return;
+	}
+	while ((dp = readdir(dir)) != NULL) {
+		if (dp->d_name[0] == '.' ||
+		    strcmp(dp->d_name, "generation") == 0)
+			continue;
+		snprintf(path, sizeof(path), 
+			CACHEDIR "/%s", dp->d_name);
+		if (unlink(path) == -1 && errno != ENOENT)
+			warn("%s", path);
+	}
+	closedir(dir);
+}
+
+/*
+ * Note a new report in all scopes containing it.
+ * Must be called in the transaction inserting the report.
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+scope_update(struct ort *db, int64_t id, time_t ctime,
+	const char *proj, int64_t machineid)
+{
+	char	*names[4];
+	size_t	 i;
+	int	 rc = 1;
+
+	/* The date is the UTC day as linked by get_html_last_report(). */
+
+	kasprintf(&names[0], "index");
+	kasprintf(&names[1], "project/%s", proj);
+	kasprintf(&names[2], "machine/%" PRId64, machineid);
+	kasprintf(&names[3], "date/%" PRId64, 
+		(int64_t)(ctime - ctime % 86400));
+
+	for (i = 0; i < 4; i++) {
+		if (rc && db_scope_insert(db, 
+		    names[i], id, ctime) == -1)
+			rc = db_scope_update_bump(db, 
+				id, /* lastid */
+				ctime, /* mtime */
+				names[i]); /* name */
+		free(names[i]);
+	}
+
+	return rc;
+}
+
+/*
+ * Fold a new report of revision "revid", whose hash is "hash", into its
+ * project's dashboard summary.
+ * The "prev" report, if not NULL, is the newest previous report from
+ * the same machine for the project.
+ * The new report is flagged as regressed if "regress" is non-zero.
+ * Must be called in the transaction inserting the report.
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+summary_update(struct ort *db, int64_t projid, int64_t revid,
+	const char *hash, time_t ctime, int success, 
+	int64_t regress, const struct report *prev)
+{
+	struct projsummary	*s;
+	int64_t			 finished, succ, pending, regressed;
+	int			 rc;
+
+	if ((s = db_projsummary_get_byproject(db, projid)) == NULL) {
+		finished = hash[0] != '\0';
+		return db_projsummary_insert(db,
+			projid, /* projectid */
+			revid, /* nrevisionid */
+			ctime, /* nctime */
+			finished, /* finished */
+			finished && success, /* success */
+			!finished, /* pending */
+			regress != 0) != -1; /* regressed */
+	}
+
+	finished = s->finished;
+	succ = s->success;
+	pending = s->pending;
+
+	/* Regressions don't depend on the hash. */
+
+	regressed = s->regressed + (regress != 0) - 
+		(prev != NULL && prev->regress != 0);
+
+	if (hash[0] == '\0' || revid != s->nrevisionid) {
+		/* 
+		 * A new newest hash: every other machine is pending.
+		 * The empty hash is always considered old.
+		 */
+		pending = finished + pending - (prev != NULL);
+		if (hash[0] != '\0') {
+			finished = 1;
+			succ = success;
+		} else {
+			finished = succ = 0;
+			pending++;
+		}
+	} else if (prev == NULL) {
+		finished++;
+		succ += success;
+	} else if (prev->revisionid == s->nrevisionid) {
+		succ += success - (prev->distcheck != 0);
+	} else {
+		assert(pending > 0);
+		pending--;
+		finished++;
+		succ += success;
+	}
+
+	rc = db_projsummary_update_counts(db,
+		revid, /* nrevisionid */
+		ctime, /* nctime */
+		finished, /* finished */
+		succ, /* success */
+		pending, /* pending */
+		regressed, /* regressed */
+		projid); /* projectid */
+	db_projsummary_free(s);
+	return rc;
+}
+
+/*
+ * Fill "dur", indexed by stage, with the duration in seconds of each
+ * stage of a submission or -1 if the stage didn't complete.
+ */
+static void
+submit_durations(const struct submit *s, int64_t *dur)
+{
+	const struct kpair	*kp[STAGESZ + 1];
+	size_t			 i;
+
+	/* Each stage ends when the next starts. */
+
+	kp[0] = s->kps;
+	kp[STAGE_env + 1] = s->kpe;
+	kp[STAGE_depend + 1] = s->kpd;
+	kp[STAGE_build + 1] = s->kpb;
+	kp[STAGE_test + 1] = s->kpt;
+	kp[STAGE_install + 1] = s->kpi;
+	kp[STAGE_distcheck + 1] = s->kpc;
+
+	for (i = 0; i < STAGESZ; i++)
+		dur[i] = kp[i + 1]->parsed.i == 0 ? -1 :
+			kp[i + 1]->parsed.i - kp[i]->parsed.i;
+}
+
+/*
+ * Compare daily means for qsort(3).
+ */
+static int
+rollup_cmp(const void *p1, const void *p2)
+{
+	double	 d1 = *(const double *)p1, d2 = *(const double *)p2;
+
+	return d1 < d2 ? -1 : d1 > d2;
+}
+
+/*
+ * Check the stage durations "dur" (see submit_durations()) of a
+ * machine's report against the machine's rollup for the ROLLDAYS
+ * before "day".
+ * A stage has regressed if it's beyond REGRESSX times the median of
+ * its daily means, if there are at least ROLLMIN of them.
+ * Returns the report.regress bits.
+ */
+static int64_t
+rollup_regress(struct ort *db, int64_t projid, int64_t machineid,
+	time_t day, const int64_t *dur)
+{
+	struct rollup_q	*rq;
+	struct rollup	*ru;
+	double		 mean[ROLLDAYS], med;
+	size_t		 i, n;
+	int64_t		 regress = 0;
+
+	rq = db_rollup_list_bymachine(db, 
+		projid, /* projectid */
+		machineid, /* machineid */
+		day - ROLLDAYS * 86400); /* day ge */
+	if (rq == NULL)
+		return 0;
+
+	for (i = 0; i < STAGESZ; i++) {
+		if (dur[i] < 0)
+			continue;
+		n = 0;
+		TAILQ_FOREACH(ru, rq, _entries)
+			if (ru->stage == (enum stage)i && 
+			    ru->day < day && ru->count > 0 &&
+			    n < ROLLDAYS)
+				mean[n++] = (double)ru->total / ru->count;
+		if (n < ROLLMIN)
+			continue;
+		qsort(mean, n, sizeof(double), rollup_cmp);
+		med = n % 2 ? mean[n / 2] :
+			(mean[n / 2 - 1] + mean[n / 2]) / 2.0;
+		if (dur[i] > REGRESSX * (med < 1.0 ? 1.0 : med))
+			regress |= (int64_t)1 << i;
+	}
+
+	db_rollup_freeq(rq);
+	return regress;
+}
+
+/*
+ * Add the stage durations "dur" of a report of the machine and project
+ * to the rollup for "day".
+ * Must be called in the transaction inserting the report.
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+rollup_update(struct ort *db, int64_t projid, int64_t machineid,
+	time_t day, const int64_t *dur, int64_t regress)
+{
+	size_t	 i;
+	int64_t	 flag;
+
+	for (i = 0; i < STAGESZ; i++) {
+		if (dur[i] < 0)
+			continue;
+		flag = (regress >> i) & 1;
+		if (db_rollup_insert(db, 
+		    projid, /* projectid */
+		    machineid, /* machineid */
+		    day, /* day */
+		    (enum stage)i, /* stage */
+		    1, /* count */
+		    dur[i], /* total */
+		    flag) != -1) /* regressed */
+			continue;
+		if (!db_rollup_update_add(db, 
+		    1, /* count */
+		    dur[i], /* total */
+		    flag, /* regressed */
+		    projid, /* projectid */
+		    machineid, /* machineid */
+		    day, /* day */
+		    (enum stage)i)) /* stage */
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Count the newlines in "sz" bytes of a log.
+ */
+static int64_t
+log_newlines(const char *buf, size_t sz)
+{
+	const char	*cp, *end = buf + sz;
+	int64_t		 n = 0;
+
+	for (cp = buf; (cp = memchr(cp, '\n', end - cp)) != NULL; cp++)
+		n++;
+	return n;
+}
+
+/*
+ * Find the last LOGTAIL lines of a log of "sz" bytes.
+ */
+static const char *
+log_tail(const char *buf, size_t sz)
+{
+	const char	*cp = buf + sz;
+	size_t		 count = 0;
+
+	while (cp > buf) {
+		if (*cp == '\n' && count++ == LOGTAIL) {
+			cp++;
+			break;
+		}
+		cp--;
+	}
+	return cp;
+}
+
+/*
+ * Store the log of a submission, along with its tail and line count,
+ * as a gzip stream split into chunks of LOGCHUNK uncompressed bytes.
+ * Each chunk is fully flushed so that it may be inflated on its own.
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+logblob_insert(struct ort *db, const struct submit *s)
+{
+	z_stream	 z;
+	unsigned char	*buf;
+	const char	*log = s->kpl->parsed.s;
+	size_t		 logsz = s->kpl->valsz, offs = 0, sz, bufsz;
+	int64_t		 id, seq, line = 0, lines;
+	int		 rc = Z_OK;
+
+	lines = log_newlines(log, logsz);
+	if (logsz > 0 && log[logsz - 1] != '\n')
+		lines++;
+
+	id = db_logblob_insert(db, 
+		s->logdigest, /* digest */
+		logsz, /* size */
+		lines, /* lines */
+		log_tail(log, logsz), /* tail */
+		LOGENC_gzip, /* enc */
+		1); /* refs */
+	if (id == -1)
+		return 0;
+
+	memset(&z, 0, sizeof(z_stream));
+	if (deflateInit2(&z, LOGZLEVEL, Z_DEFLATED, 
+	    15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return 0;
+
+	/* Room for a whole chunk, its flush, and the gzip framing. */
+
+	bufsz = deflateBound(&z, LOGCHUNK) + 64;
+	buf = kmalloc(bufsz);
+
+	for (seq = 0; rc == Z_OK; seq++) {
+		sz = logsz - offs > LOGCHUNK ? LOGCHUNK : logsz - offs;
+		z.next_in = (Bytef *)(log + offs);
+		z.avail_in = sz;
+		z.next_out = buf;
+		z.avail_out = bufsz;
+		rc = deflate(&z, 
+			offs + sz == logsz ? Z_FINISH : Z_FULL_FLUSH);
+		if (rc != Z_OK && rc != Z_STREAM_END)
+			break;
+		if (z.avail_in != 0 || z.avail_out == 0 ||
+		    db_logchunk_insert(db, 
+		    id, /* logblobid */
+		    seq, /* seq */
+		    offs, /* offs */
+		    line, /* line */
+		    bufsz - z.avail_out, buf) == -1) { /* data */
+			rc = Z_STREAM_ERROR;
+			break;
+		}
+		line += log_newlines(log + offs, sz);
+		offs += sz;
+	}
+
+	deflateEnd(&z);
+	free(buf);
+	return rc == Z_STREAM_END;
+}
+
+/*
+ * Reference the log of a submission, storing it only if no other
+ * report has the same log.
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+logblob_ref(struct ort *db, const struct submit *s)
+{
+
+	if (db_logblob_count_has(db, s->logdigest) > 0)
+		return db_logblob_update_ref(db, 
+			1, /* refs */
+			s->logdigest); /* digest */
+
+	return logblob_insert(db, s);
+}
+
+/*
+ * Get the machine of a submission by its uname digest, adding it if
+ * it's the machine's first report.
+ * Returns the machine identifier or -1 on failure.
+ */
+static int64_t
+machine_ref(struct ort *db, const struct submit *s)
+{
+	struct machine	*m;
+	int64_t		 id;
+
+	if ((m = db_machine_get_byhash(db, s->unamedigest)) != NULL) {
+		id = m->id;
+		db_machine_free(m);
+		return id;
+	}
+
+	return db_machine_insert(db,
+		s->kpum->parsed.s, /* unamem */
+		s->kpun->parsed.s, /* unamen */
+		s->kpur->parsed.s, /* unamer */
+		s->kpus->parsed.s, /* unames */
+		s->unamedigest); /* hash */
+}
+
+/*
+ * Get the revision of a submission's project by its hash, adding it as
+ * first seen at "ctime" if it's the first report of it.
+ * Returns the revision identifier or -1 on failure.
+ */
+static int64_t
+revision_ref(struct ort *db, const struct submit *s, time_t ctime)
+{
+	struct revision	*rev;
+	int64_t		 id;
+
+	rev = db_revision_get_byhash(db, 
+		s->proj->id, /* projectid */
+		s->kpf->parsed.s); /* hash */
+	if (rev != NULL) {
+		id = rev->id;
+		db_revision_free(rev);
+		return id;
+	}
+
+	return db_revision_insert(db,
+		s->proj->id, /* projectid */
+		s->kpf->parsed.s, /* hash */
+		ctime); /* ctime */
+}
+
+/*
+ * Insert a submission checked by submit_check() (or read back by
+ * spool_read()) made by "userid" and its details together, updating
+ * the project's summary from the machine's previous report.
+ * This must be within a transaction, started immediate so concurrent
+ * submissions don't both use a stale summary.
+ * Returns the report identifier or -1 on failure.
+ */
+int64_t
+submit_insert(struct ort *db, const struct submit *s,
+	int64_t userid, time_t ctime)
+{
+	struct report	*prev;
+	int64_t		 id, machineid, revid, v[6], dur[STAGESZ],
+			 regress;
+	size_t		 i;
+	time_t		 day = ctime - ctime % 86400;
+
+	if ((machineid = machine_ref(db, s)) == -1 ||
+	    (revid = revision_ref(db, s, ctime)) == -1 ||
+	    !logblob_ref(db, s))
+		return -1;
+
+	submit_durations(s, dur);
+	regress = rollup_regress(db, 
+		s->proj->id, machineid, day, dur);
+
+	prev = db_report_get_latest(db,
+		s->proj->id, /* projectid */
+		machineid); /* machineid */
+	id = db_report_insert(db,
+		s->proj->id, /* projectid */
+		machineid, /* machineid */
+		revid, /* revisionid */
+		s->proj->id << 32 | machineid, /* projmachine */
+		userid, /* userid */
+		s->kps->parsed.i, /* start */
+		s->kpe->parsed.i, /* env */
+		s->kpd->parsed.i, /* depend */
+		s->kpb->parsed.i, /* build */
+		s->kpt->parsed.i, /* test */
+		s->kpi->parsed.i, /* install */
+		s->kpc->parsed.i, /* distcheck */
+		ctime, /* ctime */
+		regress, /* regress */
+		s->logdigest); /* logdigest */
+	if (id == -1 ||
+	    db_reportdetail_insert(db,
+	    id, /* reportid */
+	    s->kpuv->parsed.s) == -1 || /* unamev */
+	    !summary_update(db, s->proj->id, revid, s->kpf->parsed.s,
+	    ctime, s->kpc->parsed.i != 0, regress, prev) ||
+	    !scope_update(db, id, ctime, 
+	    s->proj->name, machineid) ||
+	    !rollup_update(db, s->proj->id, 
+	    machineid, day, dur, regress))
+		id = -1;
+
+	/* Already checked by valid_metrics(). */
+
+	for (i = 0; id != -1 && i < STAGESZ; i++) {
+		if (s->kpm[i] == NULL)
+			continue;
+		sscanf(s->kpm[i]->parsed.s, "%" SCNd64 ",%" SCNd64 
+			",%" SCNd64 ",%" SCNd64 ",%" SCNd64 ",%" SCNd64,
+			&v[0], &v[1], &v[2], &v[3], &v[4], &v[5]);
+		if (db_stagemetrics_insert(db,
+		    id, /* reportid */
+		    stages[i].stage, /* stage */
+		    v[0], /* wall */
+		    v[1], /* utime */
+		    v[2], /* stime */
+		    v[3], /* maxrss */
+		    v[4], /* inblock */
+		    v[5]) == -1) /* oublock */
+			id = -1;
+	}
+
+	db_report_free(prev);
+	return id;
+}
+
+/*
+ * Whether submissions are spooled for the committer (minci-ingest)
+ * instead of being inserted: only if the spool directory has been
+ * created by the administrator.
+ */
+int
+spool_enabled(void)
+{
+
+	return access(SPOOLDIR, F_OK) == 0;
+}
+
+/*
+ * Write one field of a spooled submission: its name and the length of
+ * its value on one line, then the value and a newline.
+ */
+static void
+spool_put(FILE *f, const char *key, const char *val, size_t sz)
+{
+
+	fprintf(f, "%s %zu\n", key, sz);
+	fwrite(val, 1, sz, f);
+	fputc('\n', f);
+}
+
+/*
+ * Write a submission checked by submit_check() made by "userid" into a
+ * new temporary file of the spool, whose name is copied into "tmp".
+ * The file is synced, but it's ignored by the committer until renamed
+ * with spool_commit().
+ * Returns zero on failure (the file is removed), non-zero on success.
+ */
+int
+spool_write(const struct submit *s, int64_t userid, time_t ctime,
+	char *tmp, size_t tmpsz)
+{
+	const struct kpair	*kp;
+	FILE			*f;
+	size_t			 i;
+	int			 fd;
+	char			 buf[64];
+
+	/* Names sort by the time of submission. */
+
+	snprintf(tmp, tmpsz, SPOOLDIR "/tmp.%020" PRId64 
+		".XXXXXXXXXX", (int64_t)ctime);
+
+	if ((fd = mkstemp(tmp)) == -1) {
+		warn("%s", tmp);
+		return 0;
+	} else if ((f = fdopen(fd, "w")) == NULL) {
+		warn("%s", tmp);
+		close(fd);
+		unlink(tmp);
+		return 0;
+	}
+
+	snprintf(buf, sizeof(buf), "%" PRId64, (int64_t)ctime);
+	spool_put(f, "ctime", buf, strlen(buf));
+	snprintf(buf, sizeof(buf), "%" PRId64, userid);
+	spool_put(f, "user-id", buf, strlen(buf));
+	spool_put(f, "machine-hash", s->unamedigest, 
+		strlen(s->unamedigest));
+	spool_put(f, "report-logdigest", s->logdigest, 
+		strlen(s->logdigest));
+
+	for (i = 0; i < SPOOLKEYS; i++) {
+		kp = *(struct kpair *const *)
+			((const char *)s + spoolkeys[i].offs);
+		spool_put(f, spoolkeys[i].name, kp->val, kp->valsz);
+	}
+
+	for (i = 0; i < STAGESZ; i++) {
+		if (s->kpm[i] == NULL)
+			continue;
+		snprintf(buf, sizeof(buf), 
+			"metrics-%s", stages[i].name);
+		spool_put(f, buf, s->kpm[i]->val, s->kpm[i]->valsz);
+	}
+
+	if (fflush(f) == EOF || ferror(f) || fsync(fd) == -1) {
+		warn("%s", tmp);
+		fclose(f);
+		unlink(tmp);
+		return 0;
+	} else if (fclose(f) == EOF) {
+		warn("%s", tmp);
+		unlink(tmp);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Make a submission written by spool_write() visible to the committer
+ * by dropping the "tmp." prefix of its name.
+ * Returns zero on failure (the file is removed), non-zero on success.
+ */
+int
+spool_commit(const char *tmp)
+{
+	char	 path[PATH_MAX];
+
+	snprintf(path, sizeof(path), SPOOLDIR "/%s", 
+		tmp + strlen(SPOOLDIR "/tmp."));
+
+	if (rename(tmp, path) == -1) {
+		warn("%s", path);
+		unlink(tmp);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Parse an integer field of a spooled submission into "v".
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+spool_int(char *val, size_t sz, int64_t *v)
+{
+	struct kpair	 kp;
+
+	memset(&kp, 0, sizeof(struct kpair));
+	kp.val = val;
+	kp.valsz = sz;
+	if (!kvalid_int(&kp))
+		return 0;
+	*v = kp.parsed.i;
+	return 1;
+}
+
+/*
+ * Set the field "key" of a spooled submission to the nil-terminated
+ * value "val", validating it as when submitted.
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+spool_field(struct spooled *sp, const char *key, char *val, size_t sz)
+{
+	struct kpair	*kp;
+	char		*digest;
+	size_t		 i;
+	int64_t		 v;
+
+	if (strcmp(key, "ctime") == 0) {
+		if (!spool_int(val, sz, &v) || v < 0)
+			return 0;
+		sp->ctime = (time_t)v;
+		return 1;
+	} else if (strcmp(key, "user-id") == 0)
+		return spool_int(val, sz, &sp->userid);
+
+	digest = NULL;
+	if (strcmp(key, "machine-hash") == 0)
+		digest = sp->s.unamedigest;
+	else if (strcmp(key, "report-logdigest") == 0)
+		digest = sp->s.logdigest;
+
+	if (digest != NULL) {
+		if (sz != MD5_DIGEST_STRING_LENGTH - 1)
+			return 0;
+		memcpy(digest, val, sz + 1);
+		return 1;
+	}
+
+	for (i = 0; i < SPOOLKEYS; i++)
+		if (strcmp(key, spoolkeys[i].name) == 0)
+			break;
+
+	if (i < SPOOLKEYS) {
+		kp = &sp->kps[i];
+		kp->val = val;
+		kp->valsz = sz;
+		if (spoolkeys[i].isint ? 
+		    !kvalid_int(kp) : !kvalid_string(kp))
+			return 0;
+		*(struct kpair **)((char *)&sp->s + 
+			spoolkeys[i].offs) = kp;
+		return 1;
+	}
+
+	if (strncmp(key, "metrics-", 8))
+		return 0;
+	for (i = 0; i < STAGESZ; i++)
+		if (strcmp(key + 8, stages[i].name) == 0)
+			break;
+	if (i == STAGESZ)
+		return 0;
+
+	kp = &sp->kps[SPOOLKEYS + i];
+	kp->val = val;
+	kp->valsz = sz;
+	if (!kvalid_stringne(kp))
+		return 0;
+	sp->s.kpm[i] = kp;
+	return 1;
+}
+
+/*
+ * Parse the "bufsz" bytes of a spool file (see spool_put()) into "sp".
+ * Each value is nil-terminated in place of its trailing newline.
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+spool_parse(struct spooled *sp, char *buf, size_t bufsz)
+{
+	char		*cp, *end = buf + bufsz, *key, *val;
+	long long	 sz;
+
+	for (cp = buf; cp < end; cp = val + sz + 1) {
+		key = cp;
+		if ((cp = memchr(key, ' ', end - key)) == NULL)
+			return 0;
+		*cp++ = '\0';
+		sz = strtoll(cp, &val, 10);
+		if (val == cp || *val++ != '\n' || 
+		    sz < 0 || sz >= end - val || val[sz] != '\n')
+			return 0;
+		val[sz] = '\0';
+		if (!spool_field(sp, key, val, sz))
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Read back a submission written by spool_write() into "sp", which
+ * must be freed with spool_free() whether or not this succeeds.
+ * This also looks up the submission's project.
+ * Returns zero on failure, non-zero on success.
+ */
+int
+spool_read(struct ort *db, const char *path, struct spooled *sp)
+{
+	struct stat	 st;
+	ssize_t		 ssz;
+	size_t		 i;
+	int		 fd;
+
+	memset(sp, 0, sizeof(struct spooled));
+	sp->ctime = sp->userid = -1;
+
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		warn("%s", path);
+		return 0;
+	} else if (fstat(fd, &st) == -1) {
+		warn("%s", path);
+		close(fd);
+		return 0;
+	}
+
+	sp->buf = kmalloc(st.st_size + 1);
+	if ((ssz = read(fd, sp->buf, st.st_size)) == -1) {
+		warn("%s", path);
+		close(fd);
+		return 0;
+	}
+	close(fd);
+	sp->buf[ssz] = '\0';
+
+	if (!spool_parse(sp, sp->buf, ssz)) {
+		warnx("%s: malformed", path);
+		return 0;
+	}
+
+	for (i = 0; i < SPOOLKEYS; i++)
+		if (*(struct kpair **)((char *)&sp->s + 
+		    spoolkeys[i].offs) == NULL)
+			break;
+
+	if (i < SPOOLKEYS || sp->ctime < 0 || sp->userid < 0 ||
+	    sp->s.unamedigest[0] == '\0' ||
+	    sp->s.logdigest[0] == '\0') {
+		warnx("%s: incomplete", path);
+		return 0;
+	}
+
+	sp->s.proj = db_project_get_byname(db, 
+		sp->s.kpn->parsed.s); /* name */
+	if (sp->s.proj == NULL) {
+		warnx("%s: unknown project: %s", 
+			path, sp->s.kpn->parsed.s);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Free the contents of a spooled submission.
+ * Does nothing if "sp" is NULL.
+ */
+void
+spool_free(struct spooled *sp)
+{
+
+	if (sp == NULL)
+		return;
+	db_project_free(sp->s.proj);
+	free(sp->buf);
+}